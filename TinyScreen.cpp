@@ -27,7 +27,8 @@ The latest version of this library can be found at https://tiny-circuits.com/
 #include <SPI.h>
 #include <Wire.h>
 
-//These delays are used to allow hardware drawing commands on the SSD1331 to execute
+//These delays are used to allow hardware drawing commands on the SSD1331 to execute.
+//They are not slept through- the controller is marked busy and the next transfer waits out what is left
 #ifndef TS_USE_DELAY
 #define TS_USE_DELAY true
 #endif
@@ -37,67 +38,362 @@ SPI optimization defines for known architectures
 */
 
 
+//Statistics hooks, they expand to nothing unless TS_ENABLE_STATS is set in TinyScreen.h
+#if TS_ENABLE_STATS
+  #define TS_STAT_BYTE() (_statDataMode?_stats.dataBytes++:_stats.commandBytes++),
+  #define TS_STAT_WAIT() _stats.spiWaitLoops++
+  #define TS_STAT_ADD(field,n) _stats.field+=(n)
+  #define TS_STAT_DC(mode) if(_statDataMode!=(mode)){_stats.dcToggles++;_statDataMode=(mode);}
+  #define TS_STAT_CALL(api) TSStatScope tsStatScope(_stats,api)
+#else
+  #define TS_STAT_BYTE()
+  #define TS_STAT_WAIT()
+  #define TS_STAT_ADD(field,n)
+  #define TS_STAT_DC(mode)
+  #define TS_STAT_CALL(api)
+#endif
+
+//Trace hooks, they expand to nothing unless TS_ENABLE_TRACE is set in TinyScreen.h
+#if TS_ENABLE_TRACE
+  #define TS_TRACE_BYTE(x) traceByte(x),
+  #define TS_TRACE_START(flags) _traceFlags=TSTraceStart|(flags)
+#else
+  #define TS_TRACE_BYTE(x)
+  #define TS_TRACE_START(flags)
+#endif
+
+#define TS_BYTE_HOOK(x) TS_STAT_BYTE() TS_TRACE_BYTE(x)
+#define TS_SPI_TRANSFER(x) (TS_BYTE_HOOK(x) TSSPI->transfer(x))
+
 #if defined(ARDUINO_ARCH_AVR)
-  #define TS_SPI_SET_DATA_REG(x) SPDR=(x)
+  #define TS_SPI_SET_DATA_REG(x) TS_BYTE_HOOK(x) SPDR=(x)
 #elif defined(ARDUINO_ARCH_SAMD)
-  #define TS_SPI_SET_DATA_REG(x) if(_externalIO){SERCOM1->SPI.DATA.bit.DATA=(x);}else{SERCOM4->SPI.DATA.bit.DATA=(x);}
+  #define TS_SPI_SET_DATA_REG(x) if(TS_BYTE_HOOK(x) _externalIO){SERCOM1->SPI.DATA.bit.DATA=(x);}else{SERCOM4->SPI.DATA.bit.DATA=(x);}
 #elif defined(ARDUINO_ARCH_ESP8266)
-  #define TS_SPI_SET_DATA_REG(x) SPI1W0 = (x); SPI1CMD |= SPIBUSY
+  #define TS_SPI_SET_DATA_REG(x) TS_BYTE_HOOK(x) SPI1W0 = (x); SPI1CMD |= SPIBUSY
 #else
-  #define TS_SPI_SET_DATA_REG(x) TSSPI->transfer(x)
+  #define TS_SPI_SET_DATA_REG(x) TS_SPI_TRANSFER(x)
 #endif
 
 #if defined(ARDUINO_ARCH_AVR)
-  #define TS_SPI_SEND_WAIT() while(!(SPSR & _BV(SPIF)))
+  #define TS_SPI_SEND_WAIT() while(!(SPSR & _BV(SPIF)))TS_STAT_WAIT()
 #elif defined(ARDUINO_ARCH_SAMD)
-  #define TS_SPI_SEND_WAIT() if(_externalIO){while(SERCOM1->SPI.INTFLAG.bit.DRE == 0);}else{while(SERCOM4->SPI.INTFLAG.bit.DRE == 0);}
+  #define TS_SPI_SEND_WAIT() if(_externalIO){while(SERCOM1->SPI.INTFLAG.bit.DRE == 0)TS_STAT_WAIT();}else{while(SERCOM4->SPI.INTFLAG.bit.DRE == 0)TS_STAT_WAIT();}
 #elif defined(ARDUINO_ARCH_ESP8266)
-  #define TS_SPI_SEND_WAIT() while(SPI1CMD & SPIBUSY)
+  #define TS_SPI_SEND_WAIT() while(SPI1CMD & SPIBUSY)TS_STAT_WAIT()
 #else
   #define TS_SPI_SEND_WAIT() if(0)
 #endif
 
 
+//two line buffers, shared by everything that composes a line before sending it
+//there are two so one can be composed while the other is sent by DMA
+static uint8_t TSLineBuffer[2][(TinyScreen::xMax+1)*2];
+
+#if TS_ENABLE_STATS
+//counts a call and adds how long it took to the histogram when it goes out of scope
+class TSStatScope {
+ public:
+  TSStatScope(TS_STATS &stats, uint8_t api):_stats(stats),_api(api),_start(micros()){
+    stats.calls[api]++;
+  }
+  ~TSStatScope(){
+    uint32_t us=micros()-_start;
+    uint8_t bucket=0;
+    while(us>1 && bucket<TS_STAT_BUCKETS-1){
+      us>>=1;
+      bucket++;
+    }
+    if(_stats.histogram[_api][bucket]<0xFFFF)
+      _stats.histogram[_api][bucket]++;
+  }
+ private:
+  TS_STATS &_stats;
+  uint8_t _api;
+  uint32_t _start;
+};
+#endif
+
 /*
 TinyScreen uses an I2C GPIO chip to interface with the OLED control lines and buttons
 TinyScreen+ has direct IO and uses the Arduino digital IO interface
-writeGPIO(address, data);//write to SX1505
+writeGPIO(address, data);//write to SX1505, returns 0 if it did not answer
+writeGPIO(address, data, count);//write count bytes to SX1505 registers starting at address, in one transfer
+readGPIO(address);//read an SX1505 register
+beginGPIOBatch();//keep the I2C bus between GPIO writes until endGPIOBatch()
+endGPIOBatch();//release the I2C bus, batches can be nested
 startCommand();//write SSD1331 chip select active with data/command signalling a command
 startData();//write SSD1331 chip select active with data/command signalling data
 endTransfer();//write SSD1331 chip select inactive
 getButtons();//read button states, return as four LSBs in a byte- optional button mask
+enableButtonInterrupts(pin);//only read the buttons after they change. pin is the Arduino pin wired to the SX1505 NINT line, TinyScreen+ uses the button pins
+disableButtonInterrupts();//go back to reading the buttons on every getButtons()
+*/
+
+/*
+The SX1505 is written straight through the TWI registers on AVR, Wire is used on other architectures or with
+TS_RAW_I2C set to 0. The same is written for the SERCOM I2C registers on SAMD, it is off there until it has been
+run on hardware- set TS_RAW_I2C to 1 to try it. Wire has to be started by the sketch as before.
+Between beginGPIOBatch() and endGPIOBatch() the bus is kept and each write starts with a repeated start
+instead of a stop and a new start- nothing else can use the I2C bus until the batch ends.
+Every wait gives up after TS_I2C_TIMEOUT_LOOPS turns and every step checks the bus status, so a missing SX1505,
+a NACK or a bus error ends the transaction with a stop instead of hanging. After that the SX1505 is written
+through Wire until begin() is called again, and writeGPIO() returns 0 if that fails too.
 */
 
-void TinyScreen::writeGPIO(uint8_t regAddr, uint8_t regData)
+#ifndef TS_RAW_I2C
+  #if defined(ARDUINO_ARCH_AVR)
+    #define TS_RAW_I2C 1
+  #else
+    #define TS_RAW_I2C 0
+  #endif
+#endif
+
+#ifndef TS_I2C_TIMEOUT_LOOPS
+#define TS_I2C_TIMEOUT_LOOPS 20000//several milliseconds on AVR and SAMD, a byte at 100kHz takes 90us
+#endif
+
+#if TS_RAW_I2C && defined(ARDUINO_ARCH_AVR)
+  #define TS_RAW_I2C_AVAILABLE 1
+
+static uint8_t TSSavedTWBR;
+
+//wait for the TWI to finish a step, returns the status or 0 if it never did
+static uint8_t TSI2CWait(void){
+  uint16_t loops=TS_I2C_TIMEOUT_LOOPS;
+  while(!(TWCR&_BV(TWINT)))
+    if(!--loops)return 0;
+  return TWSR&0xF8;
+}
+
+//start, or repeated start when the bus is already held, then send the address byte
+static uint8_t TSI2CStart(uint8_t address){
+  TWCR=_BV(TWINT)|_BV(TWSTA)|_BV(TWEN);
+  uint8_t status=TSI2CWait();
+  if(status!=0x08 && status!=0x10)return 0;//start or repeated start sent
+  TWDR=address;
+  TWCR=_BV(TWINT)|_BV(TWEN);
+  status=TSI2CWait();
+  return status==((address&1)?0x40:0x18);//address ACKed for read or write
+}
+
+static uint8_t TSI2CWrite(uint8_t data){
+  TWDR=data;
+  TWCR=_BV(TWINT)|_BV(TWEN);
+  return TSI2CWait()==0x28;//data ACKed
+}
+
+static void TSI2CStop(void){
+  TWCR=_BV(TWINT)|_BV(TWSTO)|_BV(TWEN);
+  uint16_t loops=TS_I2C_TIMEOUT_LOOPS;
+  while((TWCR&_BV(TWSTO)) && --loops);
+  //hand the TWI back to Wire as it leaves it when idle
+  TWCR=_BV(TWEN)|_BV(TWIE)|_BV(TWEA);
+  TWBR=TSSavedTWBR;
+}
+
+//read one byte, NACK it and stop
+static uint8_t TSI2CReadLast(uint8_t &data){
+  TWCR=_BV(TWINT)|_BV(TWEN);
+  uint8_t ok=TSI2CWait()==0x58;//data received and NACKed
+  data=TWDR;
+  TSI2CStop();
+  return ok;
+}
+
+//run the bus as fast as it goes while it is held
+static void TSI2CFast(void){
+  TSSavedTWBR=TWBR;
+  TWBR=0;
+}
+
+#elif TS_RAW_I2C && defined(ARDUINO_ARCH_SAMD)
+  #define TS_RAW_I2C_AVAILABLE 1
+
+#ifndef TS_I2C_SERCOM
+#define TS_I2C_SERCOM SERCOM3
+#endif
+
+//wait for a byte to be sent or received, returns 0 on a timeout, lost arbitration, bus error or NACK
+static uint8_t TSI2CWaitByte(void){
+  uint16_t loops=TS_I2C_TIMEOUT_LOOPS;
+  while(!(TS_I2C_SERCOM->I2CM.INTFLAG.reg&(SERCOM_I2CM_INTFLAG_MB|SERCOM_I2CM_INTFLAG_SB)))
+    if(!--loops)return 0;
+  if(TS_I2C_SERCOM->I2CM.STATUS.reg&(SERCOM_I2CM_STATUS_ARBLOST|SERCOM_I2CM_STATUS_BUSERR))return 0;
+  if(TS_I2C_SERCOM->I2CM.INTFLAG.bit.MB && TS_I2C_SERCOM->I2CM.STATUS.bit.RXNACK)return 0;
+  return 1;
+}
+
+static uint8_t TSI2CStart(uint8_t address){
+  TS_I2C_SERCOM->I2CM.ADDR.bit.ADDR=address;
+  return TSI2CWaitByte();
+}
+
+static uint8_t TSI2CWrite(uint8_t data){
+  TS_I2C_SERCOM->I2CM.DATA.bit.DATA=data;
+  return TSI2CWaitByte();
+}
+
+static void TSI2CStop(void){
+  TS_I2C_SERCOM->I2CM.CTRLB.bit.CMD=3;
+  uint16_t loops=TS_I2C_TIMEOUT_LOOPS;
+  while(TS_I2C_SERCOM->I2CM.SYNCBUSY.bit.SYSOP && --loops);
+}
+
+//the byte was already received after the read address, NACK it and stop
+static uint8_t TSI2CReadLast(uint8_t &data){
+  TS_I2C_SERCOM->I2CM.CTRLB.bit.ACKACT=1;
+  TSI2CStop();
+  TS_I2C_SERCOM->I2CM.CTRLB.bit.ACKACT=0;
+  data=TS_I2C_SERCOM->I2CM.DATA.bit.DATA;
+  return 1;
+}
+
+static void TSI2CFast(void){
+}
+
+#else
+  #define TS_RAW_I2C_AVAILABLE 0
+#endif
+
+uint8_t TinyScreen::writeGPIO(uint8_t regAddr, uint8_t regData)
+{
+  return writeGPIO(regAddr,&regData,1);
+}
+
+uint8_t TinyScreen::writeGPIO(uint8_t regAddr, const uint8_t *data, uint8_t count)
 {
+  TS_STAT_ADD(i2cTransactions,1);
+  _gpioBusy=1;
+#if TS_ENABLE_TRACE
+  traceGPIO(regAddr,TSTraceStart);
+  for(uint8_t i=0;i<count;i++)
+    traceGPIO(data[i],0);
+#endif
+#if TS_RAW_I2C_AVAILABLE
+  if(!_gpioRawFailed){
+    if(!_gpioHeld)TSI2CFast();
+    uint8_t ok=TSI2CStart(_gpioAddr<<1) && TSI2CWrite(regAddr);
+    //the SX1505 moves to the next register after each byte
+    for(uint8_t i=0;ok && i<count;i++)
+      ok=TSI2CWrite(data[i]);
+    if(ok && _gpioBatch){
+      _gpioHeld=1;
+    }else{
+      TSI2CStop();
+      _gpioHeld=0;
+    }
+    if(ok){
+      _gpioBusy=0;
+      return 1;
+    }
+    //no answer or a bus error, leave the SX1505 to Wire and try this write again there
+    _gpioRawFailed=1;
+  }
+#endif
 #if defined(ARDUINO_ARCH_AVR)
   uint8_t oldTWBR=TWBR;
   TWBR=0;
 #endif
-  Wire.beginTransmission(GPIO_ADDR+_addr);
-  Wire.write(regAddr); 
-  Wire.write(regData);
-  Wire.endTransmission();
+  Wire.beginTransmission(_gpioAddr);
+  Wire.write(regAddr);
+  for(uint8_t i=0;i<count;i++)
+    Wire.write(data[i]);
+  uint8_t ok=!Wire.endTransmission();
 #if defined(ARDUINO_ARCH_AVR)
   TWBR=oldTWBR;
+#endif
+  _gpioBusy=0;
+  return ok;
+}
+
+uint8_t TinyScreen::readGPIO(uint8_t regAddr)
+{
+  TS_STAT_ADD(i2cTransactions,1);
+  _gpioBusy=1;
+  uint8_t data=0xFF;//what the SX1505 reads with nothing driven, buttons released
+#if TS_ENABLE_TRACE
+  traceGPIO(regAddr,TSTraceStart);
+#endif
+  uint8_t done=0;
+#if TS_RAW_I2C_AVAILABLE
+  if(!_gpioRawFailed){
+    if(!_gpioHeld)TSI2CFast();
+    _gpioHeld=0;
+    if(TSI2CStart(_gpioAddr<<1) && TSI2CWrite(regAddr) && TSI2CStart((_gpioAddr<<1)|1))
+      done=TSI2CReadLast(data);
+    else
+      TSI2CStop();
+    //no answer or a bus error, leave the SX1505 to Wire and try this read again there
+    if(!done)_gpioRawFailed=1;
+  }
+#endif
+  if(!done){
+    Wire.beginTransmission(_gpioAddr);
+    Wire.write(regAddr);
+    Wire.endTransmission();
+    if(Wire.requestFrom(_gpioAddr,(uint8_t)1))
+      data=Wire.read();
+  }
+#if TS_ENABLE_TRACE
+  traceGPIO(data,TSTraceRead);
+#endif
+  _gpioBusy=0;
+  return data;
+}
+
+void TinyScreen::beginGPIOBatch(void)
+{
+  _gpioBatch++;
+}
+
+void TinyScreen::endGPIOBatch(void)
+{
+  if(_gpioBatch)_gpioBatch--;
+#if TS_RAW_I2C_AVAILABLE
+  if(!_gpioBatch && _gpioHeld){
+    TSI2CStop();
+    _gpioHeld=0;
+  }
 #endif
 }
 
+//TinyScreen+ DC and CS go straight to the port registers worked out in the constructor, other cores use digitalWrite
+#if defined(ARDUINO_ARCH_SAMD)
+  #define TS_DC_LOW()  *_dcClear=_dcMask
+  #define TS_DC_HIGH() *_dcSet=_dcMask
+  #define TS_CS_LOW()  *_csClear=_csMask
+  #define TS_CS_HIGH() *_csSet=_csMask
+#else
+  #define TS_DC_LOW()  digitalWrite(TSP_PIN_DC,LOW)
+  #define TS_DC_HIGH() digitalWrite(TSP_PIN_DC,HIGH)
+  #define TS_CS_LOW()  digitalWrite(TSP_PIN_CS,LOW)
+  #define TS_CS_HIGH() digitalWrite(TSP_PIN_CS,HIGH)
+#endif
+
 void TinyScreen::startCommand(void) {
+  waitReady();
+  TS_STAT_ADD(transactions,1);
+  TS_STAT_DC(0);
+  TS_TRACE_START(0);
   if(_externalIO){
     writeGPIO(GPIO_RegData,GPIO_CMD_START);
   }else{
-    digitalWrite(TSP_PIN_DC,LOW);
-    digitalWrite(TSP_PIN_CS,LOW);
+    TS_DC_LOW();
+    TS_CS_LOW();
   }
 }
 
 void TinyScreen::startData(void) {
+  waitReady();
+  TS_STAT_ADD(transactions,1);
+  TS_STAT_DC(1);
+  TS_TRACE_START(TSTraceData);
   if(_externalIO){
     writeGPIO(GPIO_RegData,GPIO_DATA_START);
   }else{
-    digitalWrite(TSP_PIN_DC,HIGH);
-    digitalWrite(TSP_PIN_CS,LOW);
+    TS_DC_HIGH();
+    TS_CS_LOW();
   }
 }
 
@@ -105,18 +401,22 @@ void TinyScreen::endTransfer(void) {
   if(_externalIO){
     writeGPIO(GPIO_RegData,GPIO_TRANSFER_END);
   }else{
-    digitalWrite(TSP_PIN_CS,HIGH);
+    TS_CS_HIGH();
   }
 }
 
-uint8_t TinyScreen::getButtons(uint8_t buttonMask) {
+//counts button changes seen by the interrupt, each screen keeps the count it last read the buttons at
+static volatile uint8_t TSButtonChanges=0;
+
+static void TSButtonISR(void){
+  TSButtonChanges++;
+}
+
+//buttons as four LSBs, read from the hardware
+uint8_t TinyScreen::readButtons(void) {
   uint8_t buttons=0;
   if(_externalIO){
-    Wire.beginTransmission(GPIO_ADDR+_addr);
-    Wire.write(GPIO_RegData);
-    Wire.endTransmission();
-    Wire.requestFrom(GPIO_ADDR+_addr,1);
-    buttons=Wire.read();
+    buttons=readGPIO(GPIO_RegData);
     //buttons are active low and MSBs, so flip and shift
     buttons=((~buttons)>>4)&0x0F;
   }else{
@@ -125,14 +425,71 @@ uint8_t TinyScreen::getButtons(uint8_t buttonMask) {
     if(!digitalRead(TSP_PIN_BT3))buttons|=0x04;
     if(!digitalRead(TSP_PIN_BT4))buttons|=0x08;
   }
-  if(_flipDisplay){
-    uint8_t flipped=0;
-    flipped|=((buttons&TSButtonUpperLeft)<<2);
-    flipped|=((buttons&TSButtonUpperRight)>>2);
-    flipped|=((buttons&TSButtonLowerLeft)<<2);
-    flipped|=((buttons&TSButtonLowerRight)>>2);
-    buttons=flipped;
+  return buttons;
+}
+
+//buttons as they are seen with the display upside down
+uint8_t TinyScreen::flipButtons(uint8_t buttons) {
+  uint8_t flipped=0;
+  flipped|=((buttons&TSButtonUpperLeft)<<2);
+  flipped|=((buttons&TSButtonUpperRight)>>2);
+  flipped|=((buttons&TSButtonLowerLeft)<<2);
+  flipped|=((buttons&TSButtonLowerRight)>>2);
+  return flipped;
+}
+
+void TinyScreen::enableButtonInterrupts(uint8_t interruptPin) {
+  if(_externalIO){
+    //interrupt on both edges of the four button pins, NINT is active low until the source is cleared
+    writeGPIO(GPIO_RegSenseHigh,0xFF);
+    writeGPIO(GPIO_RegInterruptSource,GPIO_BTN1|GPIO_BTN2|GPIO_BTN3|GPIO_BTN4);
+    writeGPIO(GPIO_RegInterruptMask,(uint8_t)~(GPIO_BTN1|GPIO_BTN2|GPIO_BTN3|GPIO_BTN4));
+    pinMode(interruptPin,INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(interruptPin),TSButtonISR,FALLING);
+    _buttonInterruptPin=interruptPin;
+  }else{
+    attachInterrupt(digitalPinToInterrupt(TSP_PIN_BT1),TSButtonISR,CHANGE);
+    attachInterrupt(digitalPinToInterrupt(TSP_PIN_BT2),TSButtonISR,CHANGE);
+    attachInterrupt(digitalPinToInterrupt(TSP_PIN_BT3),TSButtonISR,CHANGE);
+    attachInterrupt(digitalPinToInterrupt(TSP_PIN_BT4),TSButtonISR,CHANGE);
+  }
+  _buttonInterrupts=1;
+  //read the buttons on the next call
+  _buttonChangesSeen=TSButtonChanges-1;
+}
+
+void TinyScreen::disableButtonInterrupts(void) {
+  if(!_buttonInterrupts)return;
+  if(_externalIO){
+    writeGPIO(GPIO_RegInterruptMask,0xFF);
+    detachInterrupt(digitalPinToInterrupt(_buttonInterruptPin));
+  }else{
+    detachInterrupt(digitalPinToInterrupt(TSP_PIN_BT1));
+    detachInterrupt(digitalPinToInterrupt(TSP_PIN_BT2));
+    detachInterrupt(digitalPinToInterrupt(TSP_PIN_BT3));
+    detachInterrupt(digitalPinToInterrupt(TSP_PIN_BT4));
+  }
+  _buttonInterrupts=0;
+}
+
+uint8_t TinyScreen::getButtons(uint8_t buttonMask) {
+  uint8_t buttons;
+  if(!_buttonInterrupts){
+    buttons=readButtons();
+  }else{
+    uint8_t changes=TSButtonChanges;
+    if(changes!=_buttonChangesSeen){
+      _buttonChangesSeen=changes;
+      if(_externalIO){
+        //clear the source first, so a change during the read interrupts again
+        writeGPIO(GPIO_RegInterruptSource,GPIO_BTN1|GPIO_BTN2|GPIO_BTN3|GPIO_BTN4);
+      }
+      _buttonState=readButtons();
+    }
+    buttons=_buttonState;
   }
+  if(_flipDisplay)
+    buttons=flipButtons(buttons);
   return buttons&buttonMask;
 }
 
@@ -140,11 +497,195 @@ uint8_t TinyScreen::getButtons(void) {
   return getButtons(TSButtonUpperLeft|TSButtonUpperRight|TSButtonLowerLeft|TSButtonLowerRight);
 }
 
+/*
+Button events
+Buttons are debounced into a queue of press, release, long press and repeat events with millis() times, so UI
+code can take events without reading the buttons itself. The queue belongs to the sketch- an array of
+TS_BUTTON_EVENT with a power of two size, holding one less event than its size:
+  TS_BUTTON_EVENT events[8];
+  TS_BUTTON_QUEUE queue={events,8};
+setButtonQueue(queue);//set the queue, or 0 to go without one
+serviceButtons();//read the buttons and add events, call every few milliseconds from loop() or a timer tick
+getButtonEvent(event);//take the oldest event, returns 0 if there are none
+serviceButtons() is the only writer of head and getButtonEvent() the only writer of tail, so the two can run
+in different contexts without locking. Buttons are read with getButtons(), so they are flip aware, and with
+enableButtonInterrupts() the I2C bus is only used after a button changes. When the queue is full new
+events are dropped.
+TinyScreen+ reads the button pins directly, so serviceButtons() can run from any timer tick. The shields read
+the buttons from the SX1505 over I2C- called while the library is in the middle of a GPIO transaction or holds
+the bus in a GPIO batch, serviceButtons() does nothing and the next tick reads the buttons instead. From a
+timer interrupt that needs the register level I2C (TS_RAW_I2C on AVR), as Wire on AVR waits on its own
+interrupt. With Wire, or when the sketch uses Wire for other devices, call it from loop() on the shields.
+*/
+
+#ifndef TS_BUTTON_DEBOUNCE
+#define TS_BUTTON_DEBOUNCE 20//ms a change must hold before it counts
+#endif
+#ifndef TS_BUTTON_LONG_PRESS
+#define TS_BUTTON_LONG_PRESS 600//ms held before a long press
+#endif
+#ifndef TS_BUTTON_REPEAT
+#define TS_BUTTON_REPEAT 150//ms between repeats after a long press
+#endif
+
+static void TSPushButtonEvent(TS_BUTTON_QUEUE *queue, uint8_t type, uint8_t button, uint32_t time){
+  uint8_t head=queue->head;
+  uint8_t next=(head+1)&(queue->size-1);
+  if(next==queue->tail)return;
+  queue->events[head].time=time;
+  queue->events[head].button=button;
+  queue->events[head].type=type;
+  //the event is written before the consumer can see it
+  queue->head=next;
+}
+
+void TinyScreen::setButtonQueue(TS_BUTTON_QUEUE *queue){
+  if(queue){
+    queue->head=0;
+    queue->tail=0;
+    queue->raw=0;
+    queue->stable=0;
+    queue->held=0;
+    queue->rawTime=millis();
+  }
+  _buttonQueue=queue;
+}
+
+void TinyScreen::serviceButtons(void){
+  TS_BUTTON_QUEUE *queue=_buttonQueue;
+  if(!queue)return;
+  //the I2C bus is in use by the code this interrupted, try again on the next tick
+  if(_externalIO && (_gpioBusy || _gpioBatch))return;
+  uint32_t now=millis();
+  uint16_t t=now;
+  uint8_t raw=getButtons(0x0F);
+  if(raw!=queue->raw){
+    queue->raw=raw;
+    queue->rawTime=t;
+  }
+  if(raw!=queue->stable && (uint16_t)(t-queue->rawTime)>=TS_BUTTON_DEBOUNCE){
+    uint8_t changed=raw^queue->stable;
+    for(uint8_t i=0;i<4;i++){
+      uint8_t button=1<<i;
+      if(!(changed&button))continue;
+      if(raw&button){
+        TSPushButtonEvent(queue,TSButtonPress,button,now);
+        queue->nextTime[i]=t+TS_BUTTON_LONG_PRESS;
+      }else{
+        TSPushButtonEvent(queue,TSButtonRelease,button,now);
+      }
+    }
+    queue->stable=raw;
+    queue->held&=raw;
+  }
+  for(uint8_t i=0;i<4;i++){
+    uint8_t button=1<<i;
+    if(!(queue->stable&button) || (int16_t)(t-queue->nextTime[i])<0)continue;
+    TSPushButtonEvent(queue,(queue->held&button)?TSButtonRepeat:TSButtonLongPress,button,now);
+    queue->held|=button;
+    queue->nextTime[i]=t+TS_BUTTON_REPEAT;
+  }
+}
+
+uint8_t TinyScreen::getButtonEvent(TS_BUTTON_EVENT &event){
+  TS_BUTTON_QUEUE *queue=_buttonQueue;
+  if(!queue || queue->tail==queue->head)return 0;
+  uint8_t tail=queue->tail;
+  event.time=queue->events[tail].time;
+  event.button=queue->events[tail].button;
+  event.type=queue->events[tail].type;
+  //the slot is free once tail moves past it
+  queue->tail=(tail+1)&(queue->size-1);
+  return 1;
+}
+
+/*
+TinyScreen cost model
+Predicts how long drawing takes from the SPI clock, how the control lines are driven and how long the SSD1331
+takes for hardware commands, so drawing code can choose between a hardware command and streaming pixels.
+The defaults are set for the board type and architecture when the TinyScreen is created.
+setCostModel(model);//replace the parameters, for example after changing the SPI clock. The hardware command times are also used by setBusy()
+getCostModel();//returns the parameters in use
+predictCost(operation, count);//nanoseconds for count operations, TSCostTransfer, TSCostWindow, TSCostRect or TSCostLine, or count bytes with TSCostData
+Clocks below 1kHz are raised to 1kHz (an i2cHz of 0 still means direct IO). The byte and transfer times are worked
+out here, so predictCost() only multiplies and adds- it is called in per-row planning loops.
+*/
+
+void TinyScreen::setCostModel(const TS_COST_MODEL &model){
+  _costModel=model;
+  if(_costModel.spiHz<1000)_costModel.spiHz=1000;
+  if(_costModel.i2cHz && _costModel.i2cHz<1000)_costModel.i2cHz=1000;
+  _byteNanos=8000000UL/(_costModel.spiHz/1000)+_costModel.byteNanos;
+  //an SX1505 write is address, register and data bytes of 9 bits plus start and stop, and a transfer has two
+  _transferNanos=_costModel.i2cHz?2*(29000000UL/(_costModel.i2cHz/1000)):3*(uint32_t)_costModel.pinNanos;
+}
+
+const TS_COST_MODEL &TinyScreen::getCostModel(void){
+  return _costModel;
+}
+
+uint32_t TinyScreen::predictCost(uint8_t operation, uint32_t count){
+  const TS_COST_MODEL &m=_costModel;
+  uint32_t byte=_byteNanos;
+  uint32_t transfer=_transferNanos;
+  switch(operation){
+    case TSCostTransfer: return count*transfer;
+    case TSCostData:     return count*byte;
+    case TSCostWindow:   return count*(2*transfer+6*byte);
+    case TSCostRect:     return count*(transfer+13*byte+m.rectMicros*1000UL);
+    case TSCostLine:     return count*(transfer+8*byte+m.lineMicros*1000UL);
+  }
+  return 0;
+}
+
+/*
+Hardware command scheduling
+Accelerated commands take time to execute inside the SSD1331. Instead of delaying after sending them,
+the time they need is recorded and only the next startCommand() or startData() waits for what is left.
+setBusy(microseconds);//mark the controller busy for the given time from now
+getReadyStatus();//returns 1 if the last hardware command has had time to finish, and turns the display on first if resume() left that to it
+waitReady();//wait until getReadyStatus() returns 1
+*/
+
+void TinyScreen::setBusy(uint16_t us) {
+  TS_STAT_ADD(hardwareCommands,1);
+  _busyStart=micros();
+  _busyTime=us;
+}
+
+uint8_t TinyScreen::getReadyStatus(void) {
+  if(_busyTime && (uint32_t)(micros()-_busyStart)<_busyTime)
+    return 0;
+  _busyTime=0;
+  if(_wakePending){
+    //the supply has settled after resume(), turn the display on before reporting ready
+    _wakePending=0;
+    startCommand();
+    TS_SPI_TRANSFER(0xAF);//display on
+    endTransfer();
+  }
+  return 1;
+}
+
+void TinyScreen::waitReady(void) {
+#if TS_ENABLE_STATS
+  if(!getReadyStatus()){
+    uint32_t start=micros();
+    while(!getReadyStatus());
+    _stats.busyWaits++;
+    _stats.busyWaitMicros+=micros()-start;
+  }
+#else
+  while(!getReadyStatus());
+#endif
+}
+
 /*
 SSD1331 Basics
 goTo(x,y);//set OLED RAM to pixel address (x,y) with wrap around at x and y max
 setX(x start, x end);//set OLED RAM to x start, wrap around at x end
 setY(y start, y end);//set OLED RAM to y start, wrap around at y end
+setWindow(x start, y start, x end, y end);//like setX and setY together, but sent as one command transfer
 */
 
 void TinyScreen::goTo(uint8_t x, uint8_t y) {
@@ -157,9 +698,9 @@ void TinyScreen::setX(uint8_t x, uint8_t end) {
   if(x>xMax)x=xMax;
   if(end>xMax)end=xMax;
   startCommand();
-  TSSPI->transfer(0x15);//set column
-  TSSPI->transfer(x);
-  TSSPI->transfer(end);
+  TS_SPI_TRANSFER(0x15);//set column
+  TS_SPI_TRANSFER(x);
+  TS_SPI_TRANSFER(end);
   endTransfer();
 }
 
@@ -167,16 +708,130 @@ void TinyScreen::setY(uint8_t y, uint8_t end) {
   if(y>yMax)y=yMax;
   if(end>yMax)end=yMax;
   startCommand();
-  TSSPI->transfer(0x75);//set row
-  TSSPI->transfer(y);
-  TSSPI->transfer(end);
+  TS_SPI_TRANSFER(0x75);//set row
+  TS_SPI_TRANSFER(y);
+  TS_SPI_TRANSFER(end);
+  endTransfer();
+}
+
+void TinyScreen::setWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1) {
+  TS_STAT_CALL(TSStatSetWindow);
+  if(x0>xMax)x0=xMax;
+  if(x1>xMax)x1=xMax;
+  if(y0>yMax)y0=yMax;
+  if(y1>yMax)y1=yMax;
+  startCommand();
+  TS_SPI_TRANSFER(0x15);//set column
+  TS_SPI_TRANSFER(x0);
+  TS_SPI_TRANSFER(x1);
+  TS_SPI_TRANSFER(0x75);//set row
+  TS_SPI_TRANSFER(y0);
+  TS_SPI_TRANSFER(y1);
   endTransfer();
 }
 
+/*
+Clipping
+Every drawing function is clipped to the clip rectangle before anything is sent, so whatever is off screen
+or outside the clip rectangle costs no bus time. Coordinates can be negative or past the edge of the screen.
+The clip rectangle starts as the whole screen. setX, setY, goTo, setWindow and copyWindow are not clipped.
+setClipRect(x, y, width, height);//set the clip rectangle, it is kept on the screen
+pushClip(x, y, width, height);//save the clip rectangle, then clip to where it overlaps the new one
+popClip();//go back to the clip rectangle saved by the last pushClip
+When TS_CLIP_STACK_DEPTH rectangles are already saved, pushClip returns 0 and leaves the clip rectangle as it
+is. The push is still counted, so the matching popClip does nothing and the pops before it restore the right
+rectangles.
+*/
+
+void TinyScreen::setClipRect(int16_t x, int16_t y, int16_t w, int16_t h) {
+  int16_t x0=x<0?0:x;
+  int16_t y0=y<0?0:y;
+  int16_t x1=x+w-1>xMax?xMax:x+w-1;
+  int16_t y1=y+h-1>yMax?yMax:y+h-1;
+  if(w<=0||h<=0||x0>x1||y0>y1){
+    //nothing can be drawn
+    _clipX0=1;_clipX1=0;
+    _clipY0=1;_clipY1=0;
+    return;
+  }
+  _clipX0=x0;_clipY0=y0;
+  _clipX1=x1;_clipY1=y1;
+}
+
+uint8_t TinyScreen::pushClip(int16_t x, int16_t y, int16_t w, int16_t h) {
+  if(_clipDepth>=TS_CLIP_STACK_DEPTH){
+    if(_clipDepth<0xFF)_clipDepth++;
+    return 0;
+  }
+  uint8_t *saved=_clipStack[_clipDepth];
+  saved[0]=_clipX0;saved[1]=_clipY0;
+  saved[2]=_clipX1;saved[3]=_clipY1;
+  _clipDepth++;
+  int16_t x0=x,y0=y,x1=x+w-1,y1=y+h-1;
+  if(w<=0||h<=0||!clipRect(x0,y0,x1,y1)){
+    _clipX0=1;_clipX1=0;
+    return 1;
+  }
+  _clipX0=x0;_clipY0=y0;
+  _clipX1=x1;_clipY1=y1;
+  return 1;
+}
+
+void TinyScreen::popClip(void) {
+  if(!_clipDepth)return;
+  _clipDepth--;
+  if(_clipDepth<TS_CLIP_STACK_DEPTH){
+    const uint8_t *saved=_clipStack[_clipDepth];
+    _clipX0=saved[0];_clipY0=saved[1];
+    _clipX1=saved[2];_clipY1=saved[3];
+  }
+}
+
+//intersect an inclusive rectangle with the clip rectangle, returns 0 if nothing is left
+uint8_t TinyScreen::clipRect(int16_t &x0, int16_t &y0, int16_t &x1, int16_t &y1) {
+  if(x0<_clipX0)x0=_clipX0;
+  if(y0<_clipY0)y0=_clipY0;
+  if(x1>_clipX1)x1=_clipX1;
+  if(y1>_clipY1)y1=_clipY1;
+  return x0<=x1 && y0<=y1;
+}
+
+//Cohen-Sutherland line clipping against the clip rectangle, returns 0 if nothing is left
+uint8_t TinyScreen::clipLine(int16_t &x0, int16_t &y0, int16_t &x1, int16_t &y1) {
+  if(_clipX0>_clipX1||_clipY0>_clipY1)return 0;
+  while(1){
+    uint8_t code0=((x0<_clipX0)<<0)|((x0>_clipX1)<<1)|((y0<_clipY0)<<2)|((y0>_clipY1)<<3);
+    uint8_t code1=((x1<_clipX0)<<0)|((x1>_clipX1)<<1)|((y1<_clipY0)<<2)|((y1>_clipY1)<<3);
+    if(!(code0|code1))return 1;
+    if(code0&code1)return 0;
+    uint8_t code=code0?code0:code1;
+    int32_t x,y;
+    if(code&(1<<3)){
+      y=_clipY1;
+      x=x0+(int32_t)(x1-x0)*(y-y0)/(y1-y0);
+    }else if(code&(1<<2)){
+      y=_clipY0;
+      x=x0+(int32_t)(x1-x0)*(y-y0)/(y1-y0);
+    }else if(code&(1<<1)){
+      x=_clipX1;
+      y=y0+(int32_t)(y1-y0)*(x-x0)/(x1-x0);
+    }else{
+      x=_clipX0;
+      y=y0+(int32_t)(y1-y0)*(x-x0)/(x1-x0);
+    }
+    if(code==code0){
+      x0=x;y0=y;
+    }else{
+      x1=x;y1=y;
+    }
+  }
+}
+
 /*
 Hardware accelerated drawing functions:
 clearWindow(x start, y start, width, height);//clears specified OLED controller memory
 clearScreen();//clears entire screen
+copyWindow(x start, y start, x end, y end, new x, new y);//copies a window of OLED controller memory to a new position
 drawRect(x stary, y start, width, height, fill, 8bitcolor);//sets specified OLED controller memory to an 8 bit color, fill is a boolean
 drawRect(x stary, y start, width, height, fill, 16bitcolor);//sets specified OLED controller memory to an 8 bit color, fill is a boolean
 drawRect(x stary, y start, width, height, fill, red, green, blue);//like above, but uses 6 bit color values. Red and blue ignore the LSB.
@@ -185,20 +840,37 @@ drawLine(x1, y1, x2, y2, 16bitcolor);//draw a line from (x1,y1) to (x2,y2) with
 drawLine(x1, y1, x2, y2, red, green, blue);//like above, but uses 6 bit color values. Red and blue ignore the LSB.
 */
 
-void TinyScreen::clearWindow(uint8_t x, uint8_t y, uint8_t w, uint8_t h) {  
-  if(x>xMax||y>yMax)return;
-  uint8_t x2=x+w-1;
-  uint8_t y2=y+h-1;
-  if(x2>xMax)x2=xMax;
-  if(y2>yMax)y2=yMax;
+void TinyScreen::clearWindow(int16_t x, int16_t y, uint8_t w, uint8_t h) {
+  TS_STAT_CALL(TSStatClearWindow);
+  if(!w||!h)return;
+  int16_t x2=x+w-1;
+  int16_t y2=y+h-1;
+  if(!clipRect(x,y,x2,y2))return;
+  
+  startCommand();
+  TS_SPI_TRANSFER(0x25);//clear window
+  TS_SPI_TRANSFER(x);TS_SPI_TRANSFER(y);
+  TS_SPI_TRANSFER(x2);TS_SPI_TRANSFER(y2);
+  endTransfer();
+#if TS_USE_DELAY
+  setBusy(_costModel.rectMicros);
+#endif
+}
+
+void TinyScreen::copyWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t x, uint8_t y) {
+  TS_STAT_CALL(TSStatCopyWindow);
+  if(x0>xMax||y0>yMax||x>xMax||y>yMax)return;
+  if(x1>xMax)x1=xMax;
+  if(y1>yMax)y1=yMax;
   
   startCommand();
-  TSSPI->transfer(0x25);//clear window
-  TSSPI->transfer(x);TSSPI->transfer(y);
-  TSSPI->transfer(x2);TSSPI->transfer(y2);
+  TS_SPI_TRANSFER(0x23);//copy
+  TS_SPI_TRANSFER(x0);TS_SPI_TRANSFER(y0);
+  TS_SPI_TRANSFER(x1);TS_SPI_TRANSFER(y1);
+  TS_SPI_TRANSFER(x);TS_SPI_TRANSFER(y);
   endTransfer();
 #if TS_USE_DELAY
-  delayMicroseconds(400);
+  setBusy(_costModel.rectMicros);
 #endif
 }
 
@@ -206,88 +878,66 @@ void TinyScreen::clearScreen(){
   clearWindow(0,0,96,64);
 }
 
-void TinyScreen::drawRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t f, uint8_t r, uint8_t g, uint8_t b) 
+void TinyScreen::drawRect(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t f, uint8_t r, uint8_t g, uint8_t b) 
 {
-  if(x>xMax||y>yMax)return;
-  uint8_t x2=x+w-1;
-  uint8_t y2=y+h-1;
-  if(x2>xMax)x2=xMax;
-  if(y2>yMax)y2=yMax;
+  TS_STAT_CALL(TSStatDrawRect);
+  if(!w||!h)return;
+  int16_t x2=x+w-1;
+  int16_t y2=y+h-1;
+  if(!f && (x<_clipX0||y<_clipY0||x2>_clipX1||y2>_clipY1)){
+    //a clipped outline would have sides on the clip rectangle, draw the sides that are left as lines
+    drawLine(x,y,x2,y,r,g,b);
+    drawLine(x,y2,x2,y2,r,g,b);
+    drawLine(x,y,x,y2,r,g,b);
+    drawLine(x2,y,x2,y2,r,g,b);
+    return;
+  }
+  if(!clipRect(x,y,x2,y2))return;
   
   uint8_t fill=0;
   if(f)fill=1;
   
   startCommand();
-  TSSPI->transfer(0x26);//set fill
-  TSSPI->transfer(fill);
+  TS_SPI_TRANSFER(0x26);//set fill
+  TS_SPI_TRANSFER(fill);
   
-  TSSPI->transfer(0x22);//draw rectangle
-  TSSPI->transfer(x);TSSPI->transfer(y);
-  TSSPI->transfer(x2);TSSPI->transfer(y2);
+  TS_SPI_TRANSFER(0x22);//draw rectangle
+  TS_SPI_TRANSFER(x);TS_SPI_TRANSFER(y);
+  TS_SPI_TRANSFER(x2);TS_SPI_TRANSFER(y2);
   //outline
-  TSSPI->transfer(b);TSSPI->transfer(g);TSSPI->transfer(r);
+  TS_SPI_TRANSFER(b);TS_SPI_TRANSFER(g);TS_SPI_TRANSFER(r);
   //fill
-  TSSPI->transfer(b);TSSPI->transfer(g);TSSPI->transfer(r);
+  TS_SPI_TRANSFER(b);TS_SPI_TRANSFER(g);TS_SPI_TRANSFER(r);
   endTransfer();
 #if TS_USE_DELAY
-  delayMicroseconds(400);
+  setBusy(_costModel.rectMicros);
 #endif
 }
 
-void TinyScreen::drawRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t f, uint16_t color) 
+void TinyScreen::drawRect(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t f, uint16_t color) 
 {
-  uint16_t r,g,b;
-  if(_bitDepth){
-    r=(color)&0x1F;//five bits
-    g=(color>>5)&0x3F;//six bits
-    b=(color>>11)&0x1F;//five bits
-    r=r<<1;//shift to fill six bits
-    g=g<<0;//shift to fill six bits
-    b=b<<1;//shift to fill six bits
-  }else{
-    r=(color)&0x03;//two bits
-    g=(color>>2)&0x07;//three bits
-    b=(color>>5)&0x07;//three bits
-    r|=(r<<4)|(r<<2);//copy to fill six bits
-    g|=g<<3;//copy to fill six bits
-    b|=b<<3;//copy to fill six bits
-  }
+  uint8_t r,g,b;
+  colorToRGB6(color,r,g,b);
   drawRect(x,y,w,h,f,r,g,b);
 }
 
-void TinyScreen::drawLine(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t r, uint8_t g, uint8_t b) {  
-  if(x0>xMax)x0=xMax;
-  if(y0>yMax)y0=yMax;
-  if(x1>xMax)x1=xMax;
-  if(y1>yMax)y1=yMax;
+void TinyScreen::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t r, uint8_t g, uint8_t b) {
+  TS_STAT_CALL(TSStatDrawLine);
+  if(!clipLine(x0,y0,x1,y1))return;
   startCommand();
-  TSSPI->transfer(0x21);//draw line
-  TSSPI->transfer(x0);TSSPI->transfer(y0);
-  TSSPI->transfer(x1);TSSPI->transfer(y1);
-  TSSPI->transfer(b);TSSPI->transfer(g);TSSPI->transfer(r);
+  TS_SPI_TRANSFER(0x21);//draw line
+  TS_SPI_TRANSFER(x0);TS_SPI_TRANSFER(y0);
+  TS_SPI_TRANSFER(x1);TS_SPI_TRANSFER(y1);
+  TS_SPI_TRANSFER(b);TS_SPI_TRANSFER(g);TS_SPI_TRANSFER(r);
   endTransfer();
 #if TS_USE_DELAY
-  delayMicroseconds(100);
+  setBusy(_costModel.lineMicros);
 #endif
 }
 
-void TinyScreen::drawLine(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint16_t color) {
-  uint16_t r,g,b;
-  if(_bitDepth){
-    r=(color)&0x1F;//five bits
-    g=(color>>5)&0x3F;//six bits
-    b=(color>>11)&0x1F;//five bits
-    r=r<<1;//shift to fill six bits
-    g=g<<0;//shift to fill six bits
-    b=b<<1;//shift to fill six bits
-  }else{
-    r=(color)&0x03;//two bits
-    g=(color>>2)&0x07;//three bits
-    b=(color>>5)&0x07;//three bits
-    r|=(r<<4)|(r<<2);//copy to fill six bits
-    g|=g<<3;//copy to fill six bits
-    b|=b<<3;//copy to fill six bits
-  }
+void TinyScreen::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  uint8_t r,g,b;
+  colorToRGB6(color,r,g,b);
   drawLine(x0,y0,x1,y1,r,g,b);
 }
 
@@ -296,11 +946,13 @@ Pixel manipulation
 drawPixel(x,y,color);//set pixel (x,y) to specified color. This is slow because we need to send commands setting the x and y, then send the pixel data.
 writePixel(color);//write the current pixel to specified color. Less slow than drawPixel, but still has to ready display for pixel data
 writeBuffer(buffer,count);//optimized write of a large buffer of 8 bit data. Must be wrapped with startData() and endTransfer(), but there can be any amount of calls to writeBuffer between.
+writeBuffer16(buffer,count);//like writeBuffer, but for an array of uint16_t pixels. Each pixel is sent high byte first, so nothing has to be swapped beforehand.
 */
 
-void TinyScreen::drawPixel(uint8_t x, uint8_t y, uint16_t color)
+void TinyScreen::drawPixel(int16_t x, int16_t y, uint16_t color)
 {
-  if(x>xMax||y>yMax)return;
+  TS_STAT_CALL(TSStatDrawPixel);
+  if(x<_clipX0||x>_clipX1||y<_clipY0||y>_clipY1)return;
   goTo(x,y);
   writePixel(color);
 }
@@ -308,12 +960,13 @@ void TinyScreen::drawPixel(uint8_t x, uint8_t y, uint16_t color)
 void TinyScreen::writePixel(uint16_t color) {
   startData();
   if(_bitDepth)
-    TSSPI->transfer(color>>8);
-  TSSPI->transfer(color);
+    TS_SPI_TRANSFER(color>>8);
+  TS_SPI_TRANSFER(color);
   endTransfer();
 }
 
 void TinyScreen::writeBuffer(const uint8_t *buffer,int count) {
+  TS_STAT_CALL(TSStatWriteBuffer);
   uint8_t temp;
   TS_SPI_SET_DATA_REG(buffer[0]);
   for(int j=1;j<count;j++){
@@ -324,11 +977,41 @@ void TinyScreen::writeBuffer(const uint8_t *buffer,int count) {
   TS_SPI_SEND_WAIT();
 }
 
+void TinyScreen::writeBuffer16(const uint16_t *buffer,int count) {
+  if(count<1)return;
+  //high byte first, swapped as it goes out
+  uint16_t color=buffer[0];
+  TS_SPI_SET_DATA_REG(color>>8);
+  TS_SPI_SEND_WAIT();
+  TS_SPI_SET_DATA_REG(color);
+  for(int j=1;j<count;j++){
+    color=buffer[j];
+    TS_SPI_SEND_WAIT();
+    TS_SPI_SET_DATA_REG(color>>8);
+    TS_SPI_SEND_WAIT();
+    TS_SPI_SET_DATA_REG(color);
+  }
+  TS_SPI_SEND_WAIT();
+}
+
+void TinyScreen::writeBufferPGM(const uint8_t *buffer,int count) {
+  TS_SPI_SET_DATA_REG(pgm_read_byte(buffer));
+  for(int j=1;j<count;j++){
+    uint8_t temp=pgm_read_byte(buffer+j);
+    TS_SPI_SEND_WAIT();
+    TS_SPI_SET_DATA_REG(temp);
+  }
+  TS_SPI_SEND_WAIT();
+}
+
 /* 
 TinyScreen commands
 setBrightness(brightness);//sets main current level, valid levels are 0-15
 on();//turns display on
 off();//turns display off, uses less power
+sleep();//turns display off like off(), the controller keeps its settings and image
+resume();//turns display back on after sleep() without the reset and init of begin(), returns without waiting for the supply
+setSettleTime(microseconds);//time on() and resume() allow the OLED supply to settle, TS_BOOST_SETTLE_MICROS (10ms) by default
 setBitDepth(depth);//boolean- 0 is 8 bit, 1 is 16 bit
 setFlip(flip);//done in hardware on the SSD1331. boolean- 0 is normal, 1 is upside down
 setMirror(mirror);//done in hardware on the SSD1331. boolean- 0 is normal, 1 is mirrored across Y axis
@@ -337,8 +1020,8 @@ setMirror(mirror);//done in hardware on the SSD1331. boolean- 0 is normal, 1 is
 void TinyScreen::setBrightness(uint8_t brightness) {
   if(brightness>15)brightness=15;  
   startCommand();
-  TSSPI->transfer(0x87);//set master current
-  TSSPI->transfer(brightness);
+  TS_SPI_TRANSFER(0x87);//set master current
+  TS_SPI_TRANSFER(brightness);
   endTransfer();
 }
 
@@ -347,14 +1030,15 @@ void TinyScreen::on(void) {
     digitalWrite(TSP_PIN_SHDN,HIGH);
   }
   startCommand();//if _externalIO, this will turn boost converter on
-  delayMicroseconds(10000);
-  TSSPI->transfer(0xAF);//display on
+  delayMicroseconds(_settleMicros);
+  TS_SPI_TRANSFER(0xAF);//display on
   endTransfer();
 }
 
 void TinyScreen::off(void) {
+  _wakePending=0;
   startCommand();
-  TSSPI->transfer(0xAE);//display off
+  TS_SPI_TRANSFER(0xAE);//display off
   endTransfer();
   if(_externalIO){
     writeGPIO(GPIO_RegData,~GPIO_SHDN);//bost converter off
@@ -364,6 +1048,40 @@ void TinyScreen::off(void) {
   }
 }
 
+/*
+Only the OLED supply is switched off by sleep()- the SSD1331 keeps its registers and display RAM, so resume()
+does not need the reset and init of begin(). resume() turns the supply back on, sends the framebuffer if there
+is one and returns without waiting for the supply to settle. The settle time is recorded like a hardware command,
+so the sketch can get on with other work: the next startCommand()/startData() or waitReady() waits out what is
+left of the settle time set by setSettleTime() and turns the display on first, and getReadyStatus() turns it on
+when it first returns 1. Button reads do not, so a sketch that only polls buttons after resume() should also poll
+getReadyStatus() or call waitReady(). Drawing into the framebuffer while asleep is fine, drawing to the display
+turns the supply back on for the shields.
+*/
+
+void TinyScreen::sleep(void){
+  off();
+}
+
+void TinyScreen::resume(void){
+  uint32_t start=micros();
+  if(_externalIO){
+    writeGPIO(GPIO_RegData,GPIO_TRANSFER_END);//boost converter on, chip select inactive
+  }else{
+    digitalWrite(TSP_PIN_SHDN,HIGH);
+  }
+  if(_frameBuffer)
+    writeFrameBuffer();//sent while the supply settles
+  //the display is turned on by waitReady() once the supply has settled
+  _busyStart=start;
+  _busyTime=_settleMicros;
+  _wakePending=1;
+}
+
+void TinyScreen::setSettleTime(uint16_t us){
+  _settleMicros=us;
+}
+
 void TinyScreen::setBitDepth(uint8_t b){
   _bitDepth=b;
   writeRemap();
@@ -385,23 +1103,89 @@ void TinyScreen::setColorMode(uint8_t cm){
 }
 
 /*
-The SSD1331 remap command sets a lot of driver variables, these are kept in memory
-and are all written when a change is made.
+TinyScreen calibration
+Color correction is done by the SSD1331 itself, so pixels are sent as they are with no lookup per write.
+setContrast(red, green, blue);//contrast current of each color, 0-255. begin() sets 0x91, 0x50, 0x7D
+setPrecharge(red, green, blue);//second precharge speed of each color, 0-255. begin() sets 0x64, 0x78, 0x64
+setGrayscaleTable(table);//load 32 increasing pulse widths of up to 125 for the odd gray levels, the controller fills in the rest
+setGamma(gamma);//load a gray-scale table for a gamma curve, 1.0 is linear and higher is darker in the midtones
+setLinearGrayscale();//go back to the controller's built in linear table
+Red, green and blue are the SSD1331 colors A, B and C, which follow the pixel format in TSColorModeBGR.
 */
 
-void TinyScreen::writeRemap(void){
-  uint8_t remap=(1<<5)|(1<<2);
-  if(_flipDisplay)
-    remap|=((1<<4)|(1<<1));
-  if(_mirrorDisplay)
+const uint8_t TS_GRAYSCALE_MAX = 125;
+
+void TinyScreen::setContrast(uint8_t r, uint8_t g, uint8_t b){
+  startCommand();
+  TS_SPI_TRANSFER(0x81);//contrast for color A
+  TS_SPI_TRANSFER(r);
+  TS_SPI_TRANSFER(0x82);//contrast for color B
+  TS_SPI_TRANSFER(g);
+  TS_SPI_TRANSFER(0x83);//contrast for color C
+  TS_SPI_TRANSFER(b);
+  endTransfer();
+}
+
+void TinyScreen::setPrecharge(uint8_t r, uint8_t g, uint8_t b){
+  startCommand();
+  TS_SPI_TRANSFER(0x8A);//second precharge speed for color A
+  TS_SPI_TRANSFER(r);
+  TS_SPI_TRANSFER(0x8B);//second precharge speed for color B
+  TS_SPI_TRANSFER(g);
+  TS_SPI_TRANSFER(0x8C);//second precharge speed for color C
+  TS_SPI_TRANSFER(b);
+  endTransfer();
+}
+
+void TinyScreen::setGrayscaleTable(const uint8_t *table){
+  startCommand();
+  TS_SPI_TRANSFER(0xB8);//set gray scale table
+  for(uint8_t i=0;i<32;i++)
+    TS_SPI_TRANSFER(table[i]>TS_GRAYSCALE_MAX?TS_GRAYSCALE_MAX:table[i]);
+  endTransfer();
+}
+
+void TinyScreen::setGamma(float gamma){
+  uint8_t table[32];
+  for(uint8_t i=0;i<32;i++){
+    uint8_t width=pow((2*i+1)/63.0,gamma)*TS_GRAYSCALE_MAX+0.5;
+    //pulse widths have to keep increasing
+    uint8_t least=i?table[i-1]+1:1;
+    table[i]=width<least?least:width;
+  }
+  //and must fit under the maximum, steep curves can push the top ones over
+  uint8_t most=TS_GRAYSCALE_MAX;
+  for(uint8_t i=32;i--;){
+    if(table[i]>most)table[i]=most;
+    most=table[i]-1;
+  }
+  setGrayscaleTable(table);
+}
+
+void TinyScreen::setLinearGrayscale(void){
+  startCommand();
+  TS_SPI_TRANSFER(0xB9);//use linear gray scale table
+  endTransfer();
+}
+
+/*
+The SSD1331 remap command sets a lot of driver variables, these are kept in memory
+and are all written when a change is made.
+*/
+
+void TinyScreen::writeRemap(void){
+  uint8_t remap=(1<<5)|(1<<2);
+  if(_flipDisplay)
+    remap|=((1<<4)|(1<<1));
+  if(_mirrorDisplay)
     remap^=(1<<1);
   if(_bitDepth)
     remap|=(1<<6);
   if(_colorMode)
     remap^=(1<<2);
   startCommand();
-  TSSPI->transfer(0xA0);//set remap
-  TSSPI->transfer(remap);
+  TS_SPI_TRANSFER(0xA0);//set remap
+  TS_SPI_TRANSFER(remap);
   endTransfer();
 }
 
@@ -417,11 +1201,13 @@ void TinyScreen::begin(void) {
 
   if(_externalIO){
     //standard TinyScreen- setup GPIO, reset SSD1331
+    _gpioRawFailed=0;
     writeGPIO(GPIO_RegData,~GPIO_RES);//reset low, other pins high
     writeGPIO(GPIO_RegDir,~GPIO_RES);//set reset to output
     delay(5);
-    writeGPIO(GPIO_RegDir,~(GPIO_CS|GPIO_DC|GPIO_SHDN));//reset to input, CS/DC/SHDN output
-    writeGPIO(GPIO_RegPullUp,GPIO_BTN1|GPIO_BTN2|GPIO_BTN3|GPIO_BTN4);//button pullup enable
+    //reset to input, CS/DC/SHDN output, then button pullup enable in the next register
+    const uint8_t dirPullUp[2]={(uint8_t)~(GPIO_CS|GPIO_DC|GPIO_SHDN),GPIO_BTN1|GPIO_BTN2|GPIO_BTN3|GPIO_BTN4};
+    writeGPIO(GPIO_RegDir,dirPullUp,2);
   }else{
     //otherwise TinyScreen+, connected directly to IO pins
     pinMode(TSP_PIN_SHDN,OUTPUT);pinMode(TSP_PIN_DC,OUTPUT);pinMode(TSP_PIN_CS,OUTPUT);pinMode(TSP_PIN_RST,OUTPUT);
@@ -441,7 +1227,7 @@ void TinyScreen::begin(void) {
   off();
   startCommand();
   for(uint8_t i=0;i<32;i++)
-    TSSPI->transfer(init[i]);
+    TS_SPI_TRANSFER(init[i]);
   endTransfer();
   //use libarary functions for remaining init
   setBrightness(5);
@@ -471,6 +1257,40 @@ TinyScreen::TinyScreen(uint8_t type){
   _flipDisplay=0;
   _mirrorDisplay=0;
   _colorMode=0;
+  _busyStart=0;
+  _busyTime=0;
+  _dmaEnabled=0;
+  _frameBuffer=0;
+  _sprites=0;
+  _spriteCount=0;
+  _spriteBackground=0;
+  _clipX0=0;
+  _clipY0=0;
+  _clipX1=xMax;
+  _clipY1=yMax;
+  _clipDepth=0;
+  _tilemap=0;
+  _tileScrollX=0;
+  _tileScrollY=0;
+  _ditherMode=TSDitherNone;
+  _ditherNextY=-1;
+  _buttonInterrupts=0;
+  _buttonInterruptPin=0;
+  _buttonState=0;
+  _buttonChangesSeen=0;
+  _buttonQueue=0;
+  _gpioBatch=0;
+  _gpioHeld=0;
+  _gpioBusy=0;
+  _gpioRawFailed=0;
+  _settleMicros=TS_BOOST_SETTLE_MICROS;
+  _wakePending=0;
+#if TS_ENABLE_STATS
+  resetStats();
+  _statDataMode=0;
+#endif
+  _trace=0;
+  _traceFlags=0;
   _type=type;
   
   //type determines the SPI interface IO configuration
@@ -485,6 +1305,8 @@ TinyScreen::TinyScreen(uint8_t type){
   }else if(_type==TinyScreenPlus){
 #if defined(ARDUINO_ARCH_SAMD)
     TSSPI=&SPI1;
+#else
+    TSSPI=&SPI;
 #endif
     _externalIO=0;
   }else{
@@ -492,6 +1314,37 @@ TinyScreen::TinyScreen(uint8_t type){
     _externalIO=1;
     _addr=0;
   }
+  _gpioAddr=GPIO_ADDR+_addr;
+#if defined(ARDUINO_ARCH_SAMD)
+  //look up the port and bit of DC and CS once, instead of on every write. This is done here rather than in
+  //begin() so that startCommand() or off() before begin() write the pins as digitalWrite() did
+  _dcSet=&PORT->Group[g_APinDescription[TSP_PIN_DC].ulPort].OUTSET.reg;
+  _dcClear=&PORT->Group[g_APinDescription[TSP_PIN_DC].ulPort].OUTCLR.reg;
+  _dcMask=1ul<<g_APinDescription[TSP_PIN_DC].ulPin;
+  _csSet=&PORT->Group[g_APinDescription[TSP_PIN_CS].ulPort].OUTSET.reg;
+  _csClear=&PORT->Group[g_APinDescription[TSP_PIN_CS].ulPort].OUTCLR.reg;
+  _csMask=1ul<<g_APinDescription[TSP_PIN_CS].ulPin;
+#endif
+  
+  //cost model defaults, from the clocks begin() and the GPIO writes use
+#if defined(ARDUINO_ARCH_AVR)
+  _costModel.spiHz=F_CPU/2;
+  _costModel.i2cHz=F_CPU/16;
+  _costModel.byteNanos=500;
+#elif defined(ARDUINO_ARCH_SAMD)
+  _costModel.spiHz=F_CPU/4;
+  _costModel.i2cHz=100000;
+  _costModel.byteNanos=300;
+#else
+  _costModel.spiHz=8000000;
+  _costModel.i2cHz=400000;
+  _costModel.byteNanos=500;
+#endif
+  if(!_externalIO)_costModel.i2cHz=0;
+  _costModel.pinNanos=100;
+  _costModel.rectMicros=400;
+  _costModel.lineMicros=100;
+  setCostModel(_costModel);
 }
 
 /*
@@ -504,7 +1357,7 @@ getFontHeight();//returns height of font
 getStringWidth
 */
 
-void TinyScreen::setCursor(uint8_t x, uint8_t y){
+void TinyScreen::setCursor(int16_t x, int16_t y){
   _cursorX=x;
   _cursorY=y;
 }
@@ -542,60 +1395,1563 @@ uint8_t TinyScreen::getPrintWidth(char * st){
 }
 
 size_t TinyScreen::write(uint8_t ch){
+  TS_STAT_CALL(TSStatWrite);
   if(!_fontFirstCh)return 1;
   if(ch<_fontFirstCh || ch>_fontLastCh)return 1;
-  if(_cursorX>xMax || _cursorY>yMax)return 1;
   uint8_t chWidth=pgm_read_byte(&_fontDescriptor[ch-_fontFirstCh].width);
   uint8_t bytesPerRow=chWidth/8;
   if(chWidth>bytesPerRow*8)
     bytesPerRow++;
   uint16_t offset=pgm_read_word(&_fontDescriptor[ch-_fontFirstCh].offset)+(bytesPerRow*_fontHeight)-1;
   
-  setX(_cursorX,_cursorX+chWidth+1);
-  setY(_cursorY,_cursorY+_fontHeight);
-  
-  startData();
-  for(uint8_t y=0; y<_fontHeight && y+_cursorY<yMax+1; y++){
-    if(_bitDepth){
-      TS_SPI_SET_DATA_REG(_fontBGcolor>>8);
+  //a character is a background column, the glyph, then another background column
+  int16_t x0=_cursorX;
+  int16_t y0=_cursorY;
+  int16_t x1=_cursorX+chWidth+1;
+  int16_t y1=_cursorY+_fontHeight-1;
+  if(_fontHeight && clipRect(x0,y0,x1,y1)){
+    setWindow(x0,y0,x1,y1);
+    startData();
+    //each pixel is worked out while the one before it is still being sent
+    uint8_t sending=0;
+    for(int16_t py=y0; py<=y1; py++){
+      uint8_t y=py-_cursorY;
+      uint8_t data=0;
+      for(int16_t px=x0; px<=x1; px++){
+        uint8_t col=px-_cursorX;
+        uint16_t color=_fontBGcolor;
+        if(col>=1 && col<=chWidth){
+          uint8_t bit=col-1;
+          if(!(bit&7) || px==x0)
+            data=pgm_read_byte(_fontBitmap+offset-y-((bytesPerRow-(bit>>3)-1)*_fontHeight));
+          if(data&(0x80>>(bit&7)))
+            color=_fontColor;
+        }
+        if(sending)
+          TS_SPI_SEND_WAIT();
+        if(_bitDepth){
+          TS_SPI_SET_DATA_REG(color>>8);
+          TS_SPI_SEND_WAIT();
+        }
+        TS_SPI_SET_DATA_REG(color);
+        sending=1;
+      }
+    }
+    if(sending)
       TS_SPI_SEND_WAIT();
+    endTransfer();
+  }
+  _cursorX+=(chWidth+1);
+  return 1;
+}
+
+/*
+TinyScreen color keyed bitmaps
+Only the opaque horizontal runs of each row are sent, each in its own window, so a sprite with transparent
+corners does not have to carry the background color. The runs are worked out the first time the bitmap is
+drawn and kept in the sketch's run buffer- rows with the same single run are merged into one window.
+Without a run buffer, or if it is too small, the bitmap is scanned as it is drawn instead. The runs are
+worked out again when the bit depth changes, or when runsBpp is set to 0 after changing the bitmap.
+buildKeyedRuns(bitmap);//work out the runs now, returns 0 if the run buffer is too small
+drawKeyedBitmap(x, y, bitmap);//draw the opaque pixels of the bitmap at (x,y)
+
+A window costs far more than a pixel, most of all when the control lines go through the I2C GPIO chip. With
+the TSKeyedOverdraw flag, rows where predictCost() makes separate runs more expensive than streaming the row
+from its first to its last opaque pixel are streamed that way, drawing the transparent color between the runs. That
+is only right when the bitmap is drawn over its own transparent color, like a sprite on a solid sky.
+*/
+
+static inline uint8_t TSReadBitmap(const uint8_t *p, uint8_t progmem){
+  return progmem?pgm_read_byte(p):*p;
+}
+
+//returns 1 if the pixel at p is the transparent color
+static inline uint8_t TSIsKey(const uint8_t *p, uint8_t bpp, uint16_t key, uint8_t progmem){
+  if(bpp==2)
+    return TSReadBitmap(p,progmem)==(uint8_t)(key>>8) && TSReadBitmap(p+1,progmem)==(uint8_t)key;
+  return TSReadBitmap(p,progmem)==(uint8_t)key;
+}
+
+//returns 1 if a row with count runs is cheaper streamed from its first to its last opaque pixel
+uint8_t TinyScreen::keyedOverdraw(uint8_t count, uint16_t opaque, uint8_t span){
+  uint8_t bpp=_bitDepth+1;
+  return count>1 && predictCost(TSCostWindow,count)+predictCost(TSCostData,opaque*bpp) >
+         predictCost(TSCostWindow,1)+predictCost(TSCostData,span*bpp);
+}
+
+uint8_t TinyScreen::buildKeyedRuns(TS_KEYED_BITMAP &kb){
+  uint8_t bpp=_bitDepth+1;
+  kb.runsUsed=0;
+  kb.runsBpp=bpp;//a failed build is not retried until the bit depth changes
+  if(!kb.runs)return 0;
+  uint8_t progmem=kb.flags&TSKeyedProgmem;
+  uint16_t used=0;
+  for(uint8_t row=0;row<kb.height;row++){
+    const uint8_t *line=kb.bitmap+row*kb.width*bpp;
+    uint16_t countAt=used++;
+    if(used>kb.runsSize)return 0;
+    uint8_t count=0;
+    uint8_t first=0;
+    uint8_t last=0;
+    uint16_t opaque=0;
+    uint8_t x=0;
+    while(x<kb.width){
+      while(x<kb.width && TSIsKey(line+x*bpp,bpp,kb.transparentColor,progmem))x++;
+      if(x>=kb.width)break;
+      uint8_t start=x;
+      while(x<kb.width && !TSIsKey(line+x*bpp,bpp,kb.transparentColor,progmem))x++;
+      if(used+2>kb.runsSize)return 0;
+      kb.runs[used++]=start;
+      kb.runs[used++]=x-start;
+      if(!count)first=start;
+      last=x;
+      opaque+=x-start;
+      count++;
+    }
+    //collapse the row to one run if separate windows cost more than the pixels between them
+    if((kb.flags&TSKeyedOverdraw) && keyedOverdraw(count,opaque,last-first)){
+      used=countAt+1;
+      kb.runs[used++]=first;
+      kb.runs[used++]=last-first;
+      count=1;
     }
-    TS_SPI_SET_DATA_REG(_fontBGcolor);
-    for(uint8_t byte=0; byte<bytesPerRow; byte++){
-      uint8_t data=pgm_read_byte(_fontBitmap+offset-y-((bytesPerRow-byte-1)*_fontHeight));
-      uint8_t bits=byte*8;
-        for(uint8_t i=0; i<8 && (bits+i)<chWidth && (bits+i+_cursorX)<xMax; i++){
+    kb.runs[countAt]=count;
+  }
+  kb.runsUsed=used;
+  return 1;
+}
+
+void TinyScreen::drawKeyedRun(int16_t x, int16_t y, const TS_KEYED_BITMAP &kb, uint8_t row, uint8_t rows, uint8_t start, uint8_t length){
+  uint8_t bpp=_bitDepth+1;
+  int16_t x0=x+start;
+  int16_t x1=x0+length-1;
+  int16_t y0=y+row;
+  int16_t y1=y0+rows-1;
+  int16_t firstX=x0;
+  int16_t firstY=y0;
+  if(!clipRect(x0,y0,x1,y1))return;
+  start+=x0-firstX;
+  row+=y0-firstY;
+  setWindow(x0,y0,x1,y1);
+  startData();
+  for(int16_t r=y0;r<=y1;r++,row++){
+    const uint8_t *src=kb.bitmap+(row*kb.width+start)*bpp;
+    if(kb.flags&TSKeyedProgmem)
+      writeBufferPGM(src,(x1-x0+1)*bpp);
+    else
+      writeBuffer(src,(x1-x0+1)*bpp);
+  }
+  endTransfer();
+}
+
+void TinyScreen::drawKeyedBitmap(int16_t x, int16_t y, TS_KEYED_BITMAP &kb){
+  TS_STAT_CALL(TSStatDrawKeyedBitmap);
+  uint8_t bpp=_bitDepth+1;
+  if(kb.runs && kb.runsBpp!=bpp)
+    buildKeyedRuns(kb);
+  //every run is a window of its own
+  beginGPIOBatch();
+  if(!kb.runsUsed){
+    //no run table, find runs while drawing
+    uint8_t progmem=kb.flags&TSKeyedProgmem;
+    for(uint8_t row=0;row<kb.height;row++){
+      const uint8_t *line=kb.bitmap+row*kb.width*bpp;
+      uint8_t i=0;
+      if(kb.flags&TSKeyedOverdraw){
+        //measure the row first to see if it is cheaper as one run
+        uint8_t count=0;
+        uint8_t first=0;
+        uint8_t last=0;
+        uint16_t opaque=0;
+        while(i<kb.width){
+          while(i<kb.width && TSIsKey(line+i*bpp,bpp,kb.transparentColor,progmem))i++;
+          if(i>=kb.width)break;
+          uint8_t start=i;
+          while(i<kb.width && !TSIsKey(line+i*bpp,bpp,kb.transparentColor,progmem))i++;
+          if(!count)first=start;
+          last=i;
+          opaque+=i-start;
+          count++;
+        }
+        if(keyedOverdraw(count,opaque,last-first)){
+          drawKeyedRun(x,y,kb,row,1,first,last-first);
+          continue;
+        }
+        i=0;
+      }
+      while(i<kb.width){
+        while(i<kb.width && TSIsKey(line+i*bpp,bpp,kb.transparentColor,progmem))i++;
+        if(i>=kb.width)break;
+        uint8_t start=i;
+        while(i<kb.width && !TSIsKey(line+i*bpp,bpp,kb.transparentColor,progmem))i++;
+        drawKeyedRun(x,y,kb,row,1,start,i-start);
+      }
+    }
+    endGPIOBatch();
+    return;
+  }
+  const uint8_t *r=kb.runs;
+  uint8_t row=0;
+  while(row<kb.height){
+    uint8_t count=*r++;
+    if(count==1){
+      //merge following rows that have the same single run
+      uint8_t rows=1;
+      while(row+rows<kb.height && r[2]==1 && r[3]==r[0] && r[4]==r[1]){
+        r+=3;
+        rows++;
+      }
+      drawKeyedRun(x,y,kb,row,rows,r[0],r[1]);
+      r+=2;
+      row+=rows;
+      continue;
+    }
+    for(uint8_t n=0;n<count;n++,r+=2)
+      drawKeyedRun(x,y,kb,row,1,r[0],r[1]);
+    row++;
+  }
+  endGPIOBatch();
+}
+
+/*
+TinyScreen RLE images
+RLE images are stored in PROGMEM and expanded straight into the SPI data register. The converter in
+extras/TinyScreenRLE.py makes them from PNG or PPM files. The format is:
+width, height, flags (bit 0 set for 16 bit pixels), then packets until every pixel is covered:
+0LLLLLLL, then L+1 pixels//literal pixels
+10LLLLLL, pixel//run of L+1 copies of one pixel
+11LLLLLL, LLLLLLLL, pixel//run of L+1 copies of one pixel, 14 bit length
+Pixels are one or two bytes in the same order as writeBuffer(). Runs that cover whole rows of the image
+are drawn as hardware rectangles when that is cheaper than streaming them.
+drawRLE(x, y, image);//draw an RLE image with its upper left corner at (x,y)
+*/
+
+void TinyScreen::drawRLE(int16_t x, int16_t y, const uint8_t *image){
+  TS_STAT_CALL(TSStatDrawRLE);
+  uint8_t width=pgm_read_byte(image);
+  uint8_t height=pgm_read_byte(image+1);
+  uint8_t bpp=(pgm_read_byte(image+2)&0x01)+1;
+  if(bpp!=_bitDepth+1)return;
+  const uint8_t *p=image+3;
+  //visible part of the image
+  int16_t vx0=x;
+  int16_t vy0=y;
+  int16_t vx1=x+width-1;
+  int16_t vy1=y+height-1;
+  if(!width||!height||!clipRect(vx0,vy0,vx1,vy1))return;
+  //a run must save more than the rectangle command, the wait for it and a new window
+  uint32_t rectCost=predictCost(TSCostRect,1)+predictCost(TSCostWindow,1);
+  setWindow(vx0,vy0,vx1,vy1);
+  startData();
+  uint8_t col=0;
+  uint8_t row=0;
+  while(row<height){
+    uint8_t c=pgm_read_byte(p++);
+    uint16_t count;
+    uint8_t isRun=c&0x80;
+    if(!isRun){
+      count=c+1;
+    }else if((c&0xC0)==0x80){
+      count=(c&0x3F)+1;
+    }else{
+      count=(((c&0x3F)<<8)|pgm_read_byte(p++))+1;
+    }
+    uint8_t hi=0;
+    uint8_t lo=0;
+    if(isRun){
+      if(bpp==2)hi=pgm_read_byte(p++);
+      lo=pgm_read_byte(p++);
+    }
+    while(count && row<height){
+      //whole rows of a run as a rectangle
+      if(isRun && col==0 && count>=width && predictCost(TSCostData,(uint32_t)(count/width)*width*bpp)>rectCost){
+        uint8_t rows=count/width;
+        int16_t ry0=y+row;
+        int16_t ry1=ry0+rows-1;
+        if(ry0<vy0)ry0=vy0;
+        if(ry1>vy1)ry1=vy1;
+        if(ry0<=ry1){
+          endTransfer();
+          drawRect(vx0,ry0,vx1-vx0+1,ry1-ry0+1,TSRectangleFilled,(uint16_t)((hi<<8)|lo));
+          if(y+row+rows<=vy1){
+            setWindow(vx0,y+row+rows,vx1,vy1);
+          }
+          startData();
+        }
+        row+=rows;
+        count-=(uint16_t)rows*width;
+        continue;
+      }
+      if(!isRun){
+        if(bpp==2)hi=pgm_read_byte(p++);
+        lo=pgm_read_byte(p++);
+      }
+      int16_t px=x+col;
+      int16_t py=y+row;
+      if(px>=vx0 && px<=vx1 && py>=vy0 && py<=vy1){
+        if(bpp==2){
+          TS_SPI_SET_DATA_REG(hi);
           TS_SPI_SEND_WAIT();
-          if(data&(0x80>>i)){
-            if(_bitDepth){
-              TS_SPI_SET_DATA_REG(_fontColor>>8);
-              TS_SPI_SEND_WAIT();
-            }
-            TS_SPI_SET_DATA_REG(_fontColor);
-           }else{
-            if(_bitDepth){
-              TS_SPI_SET_DATA_REG(_fontBGcolor>>8);
-              TS_SPI_SEND_WAIT();
+        }
+        TS_SPI_SET_DATA_REG(lo);
+        TS_SPI_SEND_WAIT();
+      }
+      count--;
+      if(++col>=width){
+        col=0;
+        row++;
+      }
+    }
+  }
+  endTransfer();
+}
+
+/*
+TinyScreen indexed color bitmaps
+Indexed bitmaps store 1, 2 or 4 bit palette indexes, packed MSB first with each row starting on a new byte.
+The palette holds 2, 4 or 16 colors at the current bit depth. Indexes are expanded a nibble at a time from
+a 16 entry table of ready-to-send pixel bytes, built from the palette on each call.
+drawIndexed(x, y, width, height, bitsPerPixel, bitmap, palette);//draw a PROGMEM indexed bitmap at (x,y)
+*/
+
+void TinyScreen::drawIndexed(int16_t x, int16_t y, uint8_t width, uint8_t height, uint8_t bitsPerPixel, const uint8_t *bitmap, const uint16_t *palette){
+  TS_STAT_CALL(TSStatDrawIndexed);
+  if(bitsPerPixel!=1 && bitsPerPixel!=2 && bitsPerPixel!=4)return;
+  int16_t vx0=x;
+  int16_t vy0=y;
+  int16_t vx1=x+width-1;
+  int16_t vy1=y+height-1;
+  if(!width||!height||!clipRect(vx0,vy0,vx1,vy1))return;
+  uint8_t bpp=_bitDepth+1;
+  uint8_t perNibble=4/bitsPerPixel;
+  uint8_t mask=(1<<bitsPerPixel)-1;
+  //pixel bytes for every nibble value
+  uint8_t lut[16][8];
+  for(uint8_t n=0;n<16;n++){
+    uint8_t *out=lut[n];
+    for(uint8_t k=0;k<perNibble;k++){
+      uint16_t color=palette[(n>>(4-bitsPerPixel*(k+1)))&mask];
+      if(_bitDepth)*out++=color>>8;
+      *out++=color;
+    }
+  }
+  uint8_t nibbleBytes=perNibble*bpp;
+  uint8_t bytesPerRow=((uint16_t)width*bitsPerPixel+7)/8;
+  int16_t c0=vx0-x;
+  int16_t c1=vx1-x;
+  setWindow(vx0,vy0,vx1,vy1);
+  startData();
+  for(int16_t row=vy0-y;row<=vy1-y;row++){
+    const uint8_t *src=bitmap+row*bytesPerRow;
+    int16_t px=0;
+    for(uint8_t b=0;b<bytesPerRow && px<=c1;b++){
+      uint8_t data=pgm_read_byte(src+b);
+      for(uint8_t half=0;half<2 && px<=c1;half++){
+        const uint8_t *pixels=lut[half?data&0x0F:data>>4];
+        if(px>=c0 && px+perNibble-1<=c1){
+          for(uint8_t i=0;i<nibbleBytes;i++){
+            TS_SPI_SET_DATA_REG(pixels[i]);
+            TS_SPI_SEND_WAIT();
+          }
+        }else{
+          for(uint8_t k=0;k<perNibble;k++){
+            if(px+k>=c0 && px+k<=c1){
+              for(uint8_t i=0;i<bpp;i++){
+                TS_SPI_SET_DATA_REG(pixels[k*bpp+i]);
+                TS_SPI_SEND_WAIT();
+              }
             }
-            TS_SPI_SET_DATA_REG(_fontBGcolor);
           }
+        }
+        px+=perNibble;
       }
     }
-    TS_SPI_SEND_WAIT();
-    if((_cursorX+chWidth)<xMax){
+  }
+  endTransfer();
+}
+
+/*
+TinyScreen color conversion
+TS_RGB8(r,g,b) and TS_RGB16(r,g,b) in TinyScreen.h make colors from 8 bit channels at compile time.
+Buffers of TSFormat8b, TSFormat16b or TSFormatRGB888 pixels can be converted in memory, or as they are sent
+so nothing has to be converted ahead of time. 8 bit pixels go to 16 bits through a 256 entry table in PROGMEM.
+convertBuffer(source, sourceFormat, destination, destinationFormat, count);//convert count pixels to TSFormat8b or TSFormat16b, source and destination can be the same buffer
+writeBuffer(buffer, count, format);//like writeBuffer(buffer, count), but sends count pixels of any format at the current bit depth
+*/
+
+#define TS_8B_TO_16B_4(i)  TS_8bTo16b(i),TS_8bTo16b(i+1),TS_8bTo16b(i+2),TS_8bTo16b(i+3)
+#define TS_8B_TO_16B_16(i) TS_8B_TO_16B_4(i),TS_8B_TO_16B_4(i+4),TS_8B_TO_16B_4(i+8),TS_8B_TO_16B_4(i+12)
+#define TS_8B_TO_16B_64(i) TS_8B_TO_16B_16(i),TS_8B_TO_16B_16(i+16),TS_8B_TO_16B_16(i+32),TS_8B_TO_16B_16(i+48)
+
+static const uint16_t TS8bTo16bTable[256] PROGMEM = {
+  TS_8B_TO_16B_64(0),TS_8B_TO_16B_64(64),TS_8B_TO_16B_64(128),TS_8B_TO_16B_64(192)
+};
+
+void TinyScreen::convertBuffer(const void *source, uint8_t sourceFormat, void *destination, uint8_t destinationFormat, uint16_t count){
+  const uint8_t *src=(const uint8_t *)source;
+  uint8_t *dst=(uint8_t *)destination;
+  if(sourceFormat==destinationFormat){
+    memmove(dst,src,(uint32_t)count*(sourceFormat==TSFormatRGB888?3:sourceFormat+1));
+    return;
+  }
+  if(destinationFormat==TSFormat16b){
+    uint16_t *dst16=(uint16_t *)destination;
+    if(sourceFormat==TSFormat8b){
+      //backwards, so the same buffer can grow into the space after it
+      for(uint16_t i=count;i--;)
+        dst16[i]=pgm_read_word(&TS8bTo16bTable[src[i]]);
+    }else if(sourceFormat==TSFormatRGB888){
+      for(uint16_t i=0;i<count;i++,src+=3)
+        dst16[i]=TS_RGB16(src[0],src[1],src[2]);
+    }
+  }else if(destinationFormat==TSFormat8b){
+    if(sourceFormat==TSFormat16b){
+      const uint16_t *src16=(const uint16_t *)source;
+      for(uint16_t i=0;i<count;i++)
+        dst[i]=TS_16bTo8b(src16[i]);
+    }else if(sourceFormat==TSFormatRGB888){
+      for(uint16_t i=0;i<count;i++,src+=3)
+        dst[i]=TS_RGB8(src[0],src[1],src[2]);
+    }
+  }
+}
+
+void TinyScreen::writeBuffer(const void *buffer, int count, uint8_t format){
+  if(format==TSFormat8b && !_bitDepth){
+    writeBuffer((const uint8_t *)buffer,count);
+    return;
+  }
+  if(format==TSFormat16b && _bitDepth){
+    writeBuffer16((const uint16_t *)buffer,count);
+    return;
+  }
+  const uint8_t *src=(const uint8_t *)buffer;
+  const uint16_t *src16=(const uint16_t *)buffer;
+  for(int i=0;i<count;i++){
+    //the next pixel is converted while the last byte is still going out
+    uint16_t color;
+    if(format==TSFormat8b){
+      color=pgm_read_word(&TS8bTo16bTable[src[i]]);
+    }else if(format==TSFormat16b){
+      color=_bitDepth?src16[i]:TS_16bTo8b(src16[i]);
+    }else{
+      const uint8_t *p=src+i*3;
+      color=_bitDepth?TS_RGB16(p[0],p[1],p[2]):TS_RGB8(p[0],p[1],p[2]);
+    }
+    if(i)TS_SPI_SEND_WAIT();
+    if(_bitDepth){
+      TS_SPI_SET_DATA_REG(color>>8);
+      TS_SPI_SEND_WAIT();
+    }
+    TS_SPI_SET_DATA_REG(color);
+  }
+  if(count>0)TS_SPI_SEND_WAIT();
+}
+
+/*
+TinyScreen dithering
+Photos and smooth gradients band badly in 3-3-2 color. Rows of TSFormat16b or TSFormatRGB888 pixels can be
+dithered down to 8 bit pixels as they are sent, so 8 bit mode can be kept for its shorter transfers.
+setDither(mode);//TSDitherNone, TSDitherOrdered for a 4x4 Bayer threshold per pixel, or TSDitherDiffusion for Floyd-Steinberg
+ditherRow(source, format, destination, count, x, y);//dither up to 96 pixels of a row at screen position (x,y) into 8 bit pixels
+writeDitheredRow(source, format, count, x, y);//like above, but sends the row. Must be wrapped with startData() and endTransfer(), in 16 bit mode the row is sent undithered
+Ordered dithering keeps no state, so rows can be drawn in any order. Error diffusion carries one line of
+error from each row to the next- draw the rows of an image top to bottom, a row that does not follow the
+last one starts a new image.
+*/
+
+//Bayer 4x4 thresholds, scaled to 0-255 with the half step already added
+static const uint8_t TSBayer4x4[16] PROGMEM = {
+    8,136, 40,168,
+  200, 72,232,104,
+   56,184, 24,152,
+  248,120,216, 88
+};
+
+//error carried to the next row, one signed byte per channel for each column
+static int8_t TSDitherError[(TinyScreen::xMax+1)*3];
+
+static inline void TSReadRGB(const uint8_t *src, uint8_t format, uint8_t i, uint8_t *rgb){
+  if(format==TSFormatRGB888){
+    src+=i*3;
+    rgb[0]=src[0];
+    rgb[1]=src[1];
+    rgb[2]=src[2];
+  }else{
+    uint16_t c=((const uint16_t *)src)[i];
+    uint8_t r=c&0x1F;
+    uint8_t g=(c>>5)&0x3F;
+    uint8_t b=c>>11;
+    rgb[0]=(r<<3)|(r>>2);
+    rgb[1]=(g<<2)|(g>>4);
+    rgb[2]=(b<<3)|(b>>2);
+  }
+}
+
+void TinyScreen::setDither(uint8_t mode){
+  _ditherMode=mode;
+  _ditherNextY=-1;
+}
+
+void TinyScreen::ditherRow(const void *source, uint8_t format, uint8_t *destination, uint8_t count, int16_t x, int16_t y){
+  const uint8_t *src=(const uint8_t *)source;
+  if(format==TSFormat8b || _ditherMode==TSDitherNone){
+    convertBuffer(source,format,destination,TSFormat8b,count);
+    return;
+  }
+  uint8_t rgb[3];
+  if(_ditherMode==TSDitherOrdered){
+    for(uint8_t i=0;i<count;i++){
+      TSReadRGB(src,format,i,rgb);
+      uint8_t t=pgm_read_byte(&TSBayer4x4[((y&3)<<2)|((x+i)&3)]);
+      uint8_t r=((uint16_t)rgb[0]*3+t)>>8;
+      uint8_t g=((uint16_t)rgb[1]*7+t)>>8;
+      uint8_t b=((uint16_t)rgb[2]*7+t)>>8;
+      destination[i]=(b<<5)|(g<<2)|r;
+    }
+    return;
+  }
+  //the error line holds one screen width
+  if(count>xMax+1)count=xMax+1;
+  if(y!=_ditherNextY)
+    memset(TSDitherError,0,sizeof(TSDitherError));
+  _ditherNextY=y+1;
+  int16_t right[3]={0,0,0};
+  int16_t belowRight[3]={0,0,0};
+  int8_t *err=TSDitherError;
+  for(uint8_t i=0;i<count;i++,err+=3){
+    TSReadRGB(src,format,i,rgb);
+    uint8_t q[3];
+    for(uint8_t c=0;c<3;c++){
+      int16_t v=rgb[c]+right[c]+err[c];
+      if(v<0)v=0;
+      if(v>255)v=255;
+      //red has 2 bits, green and blue 3 bits
+      int16_t level;
+      if(c==0){
+        q[c]=(v*3+128)>>8;
+        level=q[c]*85;
+      }else{
+        q[c]=(v*7+128)>>8;
+        level=(q[c]<<5)|(q[c]<<2)|(q[c]>>1);
+      }
+      int16_t e=v-level;
+      //7/16 right, 3/16 below left, 5/16 below, 1/16 below right
+      if(i){
+        int16_t bl=err[c-3]+e*3/16;
+        err[c-3]=bl<-128?-128:(bl>127?127:bl);
+      }
+      int16_t b=belowRight[c]+e*5/16;
+      err[c]=b<-128?-128:(b>127?127:b);
+      belowRight[c]=e/16;
+      right[c]=e*7/16;
+    }
+    destination[i]=(q[2]<<5)|(q[1]<<2)|q[0];
+  }
+}
+
+void TinyScreen::writeDitheredRow(const void *source, uint8_t format, uint8_t count, int16_t x, int16_t y){
+  if(_bitDepth){
+    writeBuffer(source,count,format);
+    return;
+  }
+  if(count>xMax+1)count=xMax+1;
+  if(!count)return;
+  ditherRow(source,format,TSLineBuffer[0],count,x,y);
+  writeBuffer(TSLineBuffer[0],count);
+}
+
+/*
+TinyScreen streamed fills
+Fills are computed a pixel at a time and streamed into one window, instead of one hardware command per line.
+Gradients step each 6 bit color channel in 8.8 fixed point between evenly spaced color stops.
+Patterns are 8x8 bitmaps, one byte per row MSB first, lined up with the screen so neighboring fills match.
+fillGradient(x, y, width, height, direction, color1, color2);//fill with a gradient, TSGradientHorizontal or TSGradientVertical
+fillGradient(x, y, width, height, direction, colors, count);//like above, with two or more evenly spaced color stops
+fillPattern(x, y, width, height, pattern, color, background);//fill with an 8x8 pattern such as TSPatternChecker
+*/
+
+void TinyScreen::colorToRGB6(uint16_t color, uint8_t &r, uint8_t &g, uint8_t &b){
+  if(_bitDepth){
+    r=(color&0x1F)<<1;//five bits, shift to fill six bits
+    g=(color>>5)&0x3F;//six bits
+    b=((color>>11)&0x1F)<<1;//five bits, shift to fill six bits
+  }else{
+    r=(color)&0x03;//two bits
+    g=(color>>2)&0x07;//three bits
+    b=(color>>5)&0x07;//three bits
+    r|=(r<<4)|(r<<2);//copy to fill six bits
+    g|=g<<3;//copy to fill six bits
+    b|=b<<3;//copy to fill six bits
+  }
+}
+
+uint16_t TinyScreen::RGB6ToColor(uint8_t r, uint8_t g, uint8_t b){
+  if(_bitDepth)
+    return ((uint16_t)(b>>1)<<11)|((uint16_t)g<<5)|(r>>1);
+  return ((b>>3)<<5)|((g>>3)<<2)|(r>>4);
+}
+
+//native pixel bytes for pixels from..from+n-1 of a gradient length pixels long
+void TinyScreen::gradientLine(const uint16_t *colors, uint8_t count, uint16_t length, uint16_t from, uint16_t n, uint8_t *out){
+  uint16_t last=length>1?length-1:1;
+  uint8_t seg=0;
+  uint16_t segStart=0;
+  uint16_t segEnd=last/(count-1);
+  int16_t r=0,g=0,b=0,dr=0,dg=0,db=0;
+  uint8_t loaded=0;
+  for(uint16_t p=from;p<from+n;p++){
+    while(p>segEnd && seg<count-2){
+      seg++;
+      segStart=segEnd;
+      segEnd=(uint32_t)(seg+1)*last/(count-1);
+      loaded=0;
+    }
+    if(!loaded){
+      uint8_t r1,g1,b1,r2,g2,b2;
+      colorToRGB6(colors[seg],r1,g1,b1);
+      colorToRGB6(colors[seg+1],r2,g2,b2);
+      int16_t span=segEnd-segStart;
+      if(!span)span=1;
+      dr=(((int16_t)r2-r1)<<8)/span;
+      dg=(((int16_t)g2-g1)<<8)/span;
+      db=(((int16_t)b2-b1)<<8)/span;
+      int32_t steps=p-segStart;
+      r=(r1<<8)+0x80+(int32_t)dr*steps;
+      g=(g1<<8)+0x80+(int32_t)dg*steps;
+      b=(b1<<8)+0x80+(int32_t)db*steps;
+      loaded=1;
+    }
+    uint16_t color=RGB6ToColor(r>>8,g>>8,b>>8);
+    if(_bitDepth)*out++=color>>8;
+    *out++=color;
+    r+=dr;
+    g+=dg;
+    b+=db;
+  }
+}
+
+void TinyScreen::fillGradient(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t direction, uint16_t color1, uint16_t color2){
+  uint16_t colors[2]={color1,color2};
+  fillGradient(x,y,w,h,direction,colors,2);
+}
+
+void TinyScreen::fillGradient(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t direction, const uint16_t *colors, uint8_t count){
+  TS_STAT_CALL(TSStatFillGradient);
+  if(count<2)return;
+  int16_t vx0=x;
+  int16_t vy0=y;
+  int16_t vx1=x+w-1;
+  int16_t vy1=y+h-1;
+  if(!w||!h||!clipRect(vx0,vy0,vx1,vy1))return;
+  uint8_t bpp=_bitDepth+1;
+  uint8_t visibleW=vx1-vx0+1;
+  uint8_t visibleH=vy1-vy0+1;
+  uint8_t *line=TSLineBuffer[0];
+  setWindow(vx0,vy0,vx1,vy1);
+  startData();
+  if(direction==TSGradientHorizontal){
+    //every row is the same
+    gradientLine(colors,count,w,vx0-x,visibleW,line);
+    for(uint8_t row=0;row<visibleH;row++)
+      writeBuffer(line,visibleW*bpp);
+  }else{
+    //one color per row
+    uint8_t *rowColors=TSLineBuffer[1];
+    gradientLine(colors,count,h,vy0-y,visibleH,rowColors);
+    for(uint8_t row=0;row<visibleH;row++){
+      uint8_t hi=rowColors[row*bpp];
+      uint8_t lo=rowColors[row*bpp+bpp-1];
+      for(uint8_t i=0;i<visibleW;i++){
+        if(_bitDepth){
+          TS_SPI_SET_DATA_REG(hi);
+          TS_SPI_SEND_WAIT();
+        }
+        TS_SPI_SET_DATA_REG(lo);
+        TS_SPI_SEND_WAIT();
+      }
+    }
+  }
+  endTransfer();
+}
+
+void TinyScreen::fillPattern(int16_t x, int16_t y, uint8_t w, uint8_t h, const uint8_t *pattern, uint16_t color, uint16_t background){
+  TS_STAT_CALL(TSStatFillPattern);
+  int16_t vx0=x;
+  int16_t vy0=y;
+  int16_t vx1=x+w-1;
+  int16_t vy1=y+h-1;
+  if(!w||!h||!clipRect(vx0,vy0,vx1,vy1))return;
+  setWindow(vx0,vy0,vx1,vy1);
+  startData();
+  for(int16_t row=vy0;row<=vy1;row++){
+    uint8_t bits=pattern[row&7];
+    for(int16_t col=vx0;col<=vx1;col++){
+      uint16_t c=(bits&(0x80>>(col&7)))?color:background;
       if(_bitDepth){
-        TS_SPI_SET_DATA_REG(_fontBGcolor>>8);
+        TS_SPI_SET_DATA_REG(c>>8);
         TS_SPI_SEND_WAIT();
       }
-      TS_SPI_SET_DATA_REG(_fontBGcolor);
+      TS_SPI_SET_DATA_REG(c);
       TS_SPI_SEND_WAIT();
     }
   }
   endTransfer();
-  _cursorX+=(chWidth+1);
+}
+
+/*
+TinyScreen framebuffer
+A framebuffer is a sketch-owned array of 96x64 pixels at the current bit depth- uint8_t in 8 bit mode and
+uint16_t in 16 bit mode. Drawing into it costs no bus time, writeFrameBuffer() sends all of it at once.
+setFrameBuffer(buffer);//set the framebuffer, or 0 to go without one
+writeFrameBuffer();//send the whole framebuffer to the display
+blitAlpha(x, y, width, height, bitmap, alpha);//blend an 8 or 16 bit bitmap into the framebuffer, alpha 0-255
+blitAlphaMask(x, y, width, height, bitmap, alphaPlane);//like above, with one alpha byte per pixel
+fillAlpha(x, y, width, height, color, alpha);//blend a solid color into the framebuffer, use for fades and overlays
+drawLineAA(x1, y1, x2, y2, color);//draw an anti-aliased line into the framebuffer
+drawThickLine(x1, y1, x2, y2, thickness, cap, color);//draw a line thickness pixels wide into the framebuffer, cap is TSLineCapButt, TSLineCapSquare or TSLineCapRound
+
+Blending keeps the color channels of several pixels apart in one 32 bit word with enough empty bits above
+each channel for the multiply, so a single multiply blends two 16 bit or four 8 bit pixels. The empty bits
+limit alpha to 33 levels in 16 bit mode and 9 levels in 8 bit mode, per-pixel alpha is always 33 levels.
+*/
+
+//16 bit pixels BBBBBGGGGGGRRRRR, two per word: red and blue of the first and green of the second...
+const uint32_t TS_BLEND16_MASK_A = 0x07E0F81F;
+//...then shifted down by 5, green of the first and red and blue of the second
+const uint32_t TS_BLEND16_MASK_B = 0x07C0F83F;
+//8 bit pixels BBBGGGRR, four per word: red and blue of the even pixels, then green of the even pixels
+const uint32_t TS_BLEND8_MASK_A  = 0x00E300E3;
+const uint32_t TS_BLEND8_MASK_B  = 0x001C001C;
+
+static inline uint32_t TSBlend16x2(uint32_t f, uint32_t b, uint8_t a){
+  uint8_t na=32-a;
+  uint32_t x=(((f&TS_BLEND16_MASK_A)*a+(b&TS_BLEND16_MASK_A)*na)>>5)&TS_BLEND16_MASK_A;
+  uint32_t y=((((f>>5)&TS_BLEND16_MASK_B)*a+((b>>5)&TS_BLEND16_MASK_B)*na)>>5)&TS_BLEND16_MASK_B;
+  return x|(y<<5);
+}
+
+static inline uint32_t TSBlend8x4(uint32_t f, uint32_t b, uint8_t a){
+  uint8_t na=8-a;
+  uint32_t even=((((f&TS_BLEND8_MASK_A)*a+(b&TS_BLEND8_MASK_A)*na)>>3)&TS_BLEND8_MASK_A)|
+                ((((f&TS_BLEND8_MASK_B)*a+(b&TS_BLEND8_MASK_B)*na)>>3)&TS_BLEND8_MASK_B);
+  f>>=8;
+  b>>=8;
+  uint32_t odd =((((f&TS_BLEND8_MASK_A)*a+(b&TS_BLEND8_MASK_A)*na)>>3)&TS_BLEND8_MASK_A)|
+                ((((f&TS_BLEND8_MASK_B)*a+(b&TS_BLEND8_MASK_B)*na)>>3)&TS_BLEND8_MASK_B);
+  return even|(odd<<8);
+}
+
+//single pixels, spread out far enough for 33 alpha levels
+static inline uint16_t TSBlend16(uint16_t f, uint16_t b, uint8_t a){
+  uint32_t fx=(f|((uint32_t)f<<16))&TS_BLEND16_MASK_A;
+  uint32_t bx=(b|((uint32_t)b<<16))&TS_BLEND16_MASK_A;
+  uint32_t x=((fx*a+bx*(32-a))>>5)&TS_BLEND16_MASK_A;
+  return x|(x>>16);
+}
+
+static inline uint8_t TSBlend8(uint8_t f, uint8_t b, uint8_t a){
+  uint32_t fx=(f&0x03)|((uint32_t)(f&0x1C)<<8)|((uint32_t)(f&0xE0)<<16);
+  uint32_t bx=(b&0x03)|((uint32_t)(b&0x1C)<<8)|((uint32_t)(b&0xE0)<<16);
+  uint32_t x=((fx*a+bx*(32-a))>>5)&0x00E01C03;
+  return x|(x>>8)|(x>>16);
+}
+
+void TinyScreen::setFrameBuffer(void *buffer){
+  _frameBuffer=buffer;
+}
+
+void TinyScreen::writeFrameBuffer(void){
+  TS_STAT_CALL(TSStatWriteFrameBuffer);
+  if(!_frameBuffer)return;
+  setX(0,xMax);
+  setY(0,yMax);
+  startData();
+  if(_bitDepth){
+    if(_dmaEnabled)
+      writeBuffer16DMA((const uint16_t *)_frameBuffer,(xMax+1)*(yMax+1));
+    else
+      writeBuffer16((const uint16_t *)_frameBuffer,(xMax+1)*(yMax+1));
+  }else if(_dmaEnabled){
+    writeBufferDMA((uint8_t *)_frameBuffer,(xMax+1)*(yMax+1));
+    while(!getReadyStatusDMA());
+  }else{
+    writeBuffer((const uint8_t *)_frameBuffer,(xMax+1)*(yMax+1));
+  }
+  endTransfer();
+}
+
+//clip a blit to the clip rectangle, sx and sy are set to where drawing starts in the source
+uint8_t TinyScreen::clipBlit(int16_t &x, int16_t &y, int16_t &sx, int16_t &sy, int16_t &w, int16_t &h){
+  int16_t x0=x;
+  int16_t y0=y;
+  int16_t x1=x+w-1;
+  int16_t y1=y+h-1;
+  if(w<=0||h<=0||!clipRect(x0,y0,x1,y1))return 0;
+  sx=x0-x;
+  sy=y0-y;
+  x=x0;
+  y=y0;
+  w=x1-x0+1;
+  h=y1-y0+1;
   return 1;
 }
 
+void TinyScreen::blitAlpha(int16_t x, int16_t y, uint8_t width, uint8_t height, const uint8_t *bitmap, uint8_t alpha){
+  int16_t sx,sy,w=width,h=height;
+  if(!_frameBuffer || _bitDepth || !clipBlit(x,y,sx,sy,w,h))return;
+  uint8_t a=(alpha+16)>>5;
+  if(!a)return;
+  for(int16_t row=0;row<h;row++){
+    const uint8_t *src=bitmap+(sy+row)*width+sx;
+    uint8_t *dst=(uint8_t *)_frameBuffer+(y+row)*(xMax+1)+x;
+    if(a==8){
+      memcpy(dst,src,w);
+      continue;
+    }
+    int16_t i=0;
+    for(;i+4<=w;i+=4){
+      uint32_t f=src[i]|((uint32_t)src[i+1]<<8)|((uint32_t)src[i+2]<<16)|((uint32_t)src[i+3]<<24);
+      uint32_t b=dst[i]|((uint32_t)dst[i+1]<<8)|((uint32_t)dst[i+2]<<16)|((uint32_t)dst[i+3]<<24);
+      uint32_t r=TSBlend8x4(f,b,a);
+      dst[i]=r;dst[i+1]=r>>8;dst[i+2]=r>>16;dst[i+3]=r>>24;
+    }
+    for(;i<w;i++)
+      dst[i]=TSBlend8x4(src[i],dst[i],a);
+  }
+}
+
+void TinyScreen::blitAlpha(int16_t x, int16_t y, uint8_t width, uint8_t height, const uint16_t *bitmap, uint8_t alpha){
+  int16_t sx,sy,w=width,h=height;
+  if(!_frameBuffer || !_bitDepth || !clipBlit(x,y,sx,sy,w,h))return;
+  uint8_t a=(alpha+4)>>3;
+  if(!a)return;
+  for(int16_t row=0;row<h;row++){
+    const uint16_t *src=bitmap+(sy+row)*width+sx;
+    uint16_t *dst=(uint16_t *)_frameBuffer+(y+row)*(xMax+1)+x;
+    if(a==32){
+      memcpy(dst,src,w*2);
+      continue;
+    }
+    int16_t i=0;
+    for(;i+2<=w;i+=2){
+      uint32_t r=TSBlend16x2(src[i]|((uint32_t)src[i+1]<<16),dst[i]|((uint32_t)dst[i+1]<<16),a);
+      dst[i]=r;dst[i+1]=r>>16;
+    }
+    if(i<w)
+      dst[i]=TSBlend16x2(src[i],dst[i],a);
+  }
+}
+
+void TinyScreen::blitAlphaMask(int16_t x, int16_t y, uint8_t width, uint8_t height, const uint8_t *bitmap, const uint8_t *alphaPlane){
+  int16_t sx,sy,w=width,h=height;
+  if(!_frameBuffer || _bitDepth || !clipBlit(x,y,sx,sy,w,h))return;
+  for(int16_t row=0;row<h;row++){
+    uint16_t offset=(sy+row)*width+sx;
+    uint8_t *dst=(uint8_t *)_frameBuffer+(y+row)*(xMax+1)+x;
+    for(int16_t i=0;i<w;i++)
+      dst[i]=TSBlend8(bitmap[offset+i],dst[i],(alphaPlane[offset+i]+4)>>3);
+  }
+}
+
+void TinyScreen::blitAlphaMask(int16_t x, int16_t y, uint8_t width, uint8_t height, const uint16_t *bitmap, const uint8_t *alphaPlane){
+  int16_t sx,sy,w=width,h=height;
+  if(!_frameBuffer || !_bitDepth || !clipBlit(x,y,sx,sy,w,h))return;
+  for(int16_t row=0;row<h;row++){
+    uint16_t offset=(sy+row)*width+sx;
+    uint16_t *dst=(uint16_t *)_frameBuffer+(y+row)*(xMax+1)+x;
+    for(int16_t i=0;i<w;i++)
+      dst[i]=TSBlend16(bitmap[offset+i],dst[i],(alphaPlane[offset+i]+4)>>3);
+  }
+}
+
+void TinyScreen::fillAlpha(int16_t x, int16_t y, uint8_t width, uint8_t height, uint16_t color, uint8_t alpha){
+  int16_t sx,sy,w=width,h=height;
+  if(!_frameBuffer || !clipBlit(x,y,sx,sy,w,h))return;
+  if(_bitDepth){
+    uint8_t a=(alpha+4)>>3;
+    uint32_t f=color|((uint32_t)color<<16);
+    for(int16_t row=0;row<h;row++){
+      uint16_t *dst=(uint16_t *)_frameBuffer+(y+row)*(xMax+1)+x;
+      int16_t i=0;
+      for(;i+2<=w;i+=2){
+        uint32_t r=TSBlend16x2(f,dst[i]|((uint32_t)dst[i+1]<<16),a);
+        dst[i]=r;dst[i+1]=r>>16;
+      }
+      if(i<w)
+        dst[i]=TSBlend16x2(f,dst[i],a);
+    }
+  }else{
+    uint8_t a=(alpha+16)>>5;
+    uint32_t f=(color&0xFF)*0x01010101UL;
+    for(int16_t row=0;row<h;row++){
+      uint8_t *dst=(uint8_t *)_frameBuffer+(y+row)*(xMax+1)+x;
+      int16_t i=0;
+      for(;i+4<=w;i+=4){
+        uint32_t r=TSBlend8x4(f,dst[i]|((uint32_t)dst[i+1]<<8)|((uint32_t)dst[i+2]<<16)|((uint32_t)dst[i+3]<<24),a);
+        dst[i]=r;dst[i+1]=r>>8;dst[i+2]=r>>16;dst[i+3]=r>>24;
+      }
+      for(;i<w;i++)
+        dst[i]=TSBlend8x4(f,dst[i],a);
+    }
+  }
+}
+
+//line coverage to alpha, so partly covered pixels look as bright as their coverage on the OLED
+static const uint8_t TSCoverageAlpha[16] PROGMEM = {0,9,13,15,18,19,21,23,24,25,27,28,29,30,31,32};
+
+static uint32_t TSSqrt(uint32_t n){
+  uint32_t root=0;
+  uint32_t bit=1UL<<30;
+  while(bit>n)bit>>=2;
+  while(bit){
+    if(n>=root+bit){
+      n-=root+bit;
+      root=(root>>1)+bit;
+    }else{
+      root>>=1;
+    }
+    bit>>=2;
+  }
+  return root;
+}
+
+void TinyScreen::blendPixelFB(int16_t x, int16_t y, uint16_t color, uint8_t coverage){
+  if(x<_clipX0||x>_clipX1||y<_clipY0||y>_clipY1)return;
+  uint8_t a=pgm_read_byte(&TSCoverageAlpha[coverage>>4]);
+  if(!a)return;
+  uint16_t i=y*(xMax+1)+x;
+  if(_bitDepth){
+    uint16_t *fb=(uint16_t *)_frameBuffer;
+    fb[i]=TSBlend16(color,fb[i],a);
+  }else{
+    uint8_t *fb=(uint8_t *)_frameBuffer;
+    fb[i]=TSBlend8(color,fb[i],a);
+  }
+}
+
+void TinyScreen::spanFB(int16_t x0, int16_t x1, int16_t y, uint16_t color){
+  if(y<_clipY0||y>_clipY1)return;
+  if(x0<_clipX0)x0=_clipX0;
+  if(x1>_clipX1)x1=_clipX1;
+  if(x0>x1)return;
+  if(_bitDepth){
+    uint16_t *fb=(uint16_t *)_frameBuffer+y*(xMax+1);
+    for(int16_t x=x0;x<=x1;x++)
+      fb[x]=color;
+  }else{
+    memset((uint8_t *)_frameBuffer+y*(xMax+1)+x0,color,x1-x0+1);
+  }
+}
+
+void TinyScreen::drawLineAA(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color){
+  if(!_frameBuffer)return;
+  //Xiaolin Wu's line, endpoints on whole pixels so they are drawn at full intensity
+  uint8_t steep=labs((int32_t)y1-y0)>labs((int32_t)x1-x0);
+  int16_t t;
+  if(steep){
+    t=x0;x0=y0;y0=t;
+    t=x1;x1=y1;y1=t;
+  }
+  if(x0>x1){
+    t=x0;x0=x1;x1=t;
+    t=y0;y0=y1;y1=t;
+  }
+  int32_t dx=(int32_t)x1-x0;
+  int32_t gradient=dx?(int32_t)(((int64_t)y1-y0)*65536/dx):0;
+  //only walk the part of the major axis inside the clip rectangle
+  int16_t start=x0;
+  int16_t end=x1;
+  int16_t clip0=steep?_clipY0:_clipX0;
+  int16_t clip1=steep?_clipY1:_clipX1;
+  if(start<clip0)start=clip0;
+  if(end>clip1)end=clip1;
+  if(start>end)return;
+  int32_t intery=(int32_t)y0*65536+(int32_t)((int64_t)gradient*(start-x0));
+  for(int16_t x=start;x<=end;x++){
+    int16_t y=intery>>16;
+    uint8_t frac=intery>>8;
+    if(steep){
+      blendPixelFB(y,x,color,255-frac);
+      blendPixelFB(y+1,x,color,frac);
+    }else{
+      blendPixelFB(x,y,color,255-frac);
+      blendPixelFB(x,y+1,color,frac);
+    }
+    intery+=gradient;
+  }
+}
+
+void TinyScreen::drawThickLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t thickness, uint8_t cap, uint16_t color){
+  if(!_frameBuffer || !thickness)return;
+  if(thickness>64)thickness=64;
+  //everything below is 8.8 fixed point, pixel centers are at .5
+  int32_t r=thickness*128;
+  int32_t ax=(int32_t)x0*256+128;
+  int32_t ay=(int32_t)y0*256+128;
+  int32_t bx=(int32_t)x1*256+128;
+  int32_t by=(int32_t)y1*256+128;
+  int32_t dx=(int32_t)x1-x0;
+  int32_t dy=(int32_t)y1-y0;
+  //length in 8.8, the square is scaled down by an even shift until it fits the 32 bit square root
+  uint64_t len2=((uint64_t)((int64_t)dx*dx+(int64_t)dy*dy))<<16;
+  uint8_t shift=0;
+  while(len2>>32){
+    len2>>=2;
+    shift++;
+  }
+  int32_t len=TSSqrt((uint32_t)len2)<<shift;
+  int32_t nx=0,ny=r,ex=r,ey=0;
+  if(len){
+    nx=(int32_t)(-(int64_t)dy*r*256/len);
+    ny=(int32_t)((int64_t)dx*r*256/len);
+    ex=(int32_t)((int64_t)dx*r*256/len);
+    ey=(int32_t)((int64_t)dy*r*256/len);
+  }
+  if(cap!=TSLineCapSquare && len){
+    ex=0;
+    ey=0;
+  }
+  int32_t px[4]={ax-ex+nx,ax-ex-nx,bx+ex-nx,bx+ex+nx};
+  int32_t py[4]={ay-ey+ny,ay-ey-ny,by+ey-ny,by+ey+ny};
+  int32_t top=py[0],bottom=py[0];
+  for(uint8_t i=1;i<4;i++){
+    if(py[i]<top)top=py[i];
+    if(py[i]>bottom)bottom=py[i];
+  }
+  if(cap==TSLineCapRound){
+    int32_t capTop=(ay<by?ay:by)-r;
+    int32_t capBottom=(ay>by?ay:by)+r;
+    if(capTop<top)top=capTop;
+    if(capBottom>bottom)bottom=capBottom;
+  }
+  int16_t rowStart=(top+127)>>8;
+  int16_t rowEnd=(bottom-128)>>8;
+  if(rowStart<_clipY0)rowStart=_clipY0;
+  if(rowEnd>_clipY1)rowEnd=_clipY1;
+  for(int16_t row=rowStart;row<=rowEnd;row++){
+    int32_t yc=row*256+128;
+    int32_t left=0x7FFFFFFF,right=-0x7FFFFFFF;
+    //the line body is a convex quad
+    for(uint8_t i=0;i<4;i++){
+      uint8_t j=(i+1)&3;
+      int32_t ya=py[i],yb=py[j];
+      if(ya==yb || yc<(ya<yb?ya:yb) || yc>(ya>yb?ya:yb))continue;
+      int32_t xc=px[i]+(int32_t)((int64_t)(yc-ya)*(px[j]-px[i])/(yb-ya));
+      if(xc<left)left=xc;
+      if(xc>right)right=xc;
+    }
+    if(left<=right && (len || cap!=TSLineCapRound))
+      spanFB((left+127)>>8,(right-128)>>8,row,color);
+    if(cap==TSLineCapRound){
+      for(uint8_t end=0;end<2;end++){
+        int32_t cy=end?by:ay;
+        int32_t cx=end?bx:ax;
+        int32_t d=yc-cy;
+        if(d<-r||d>r)continue;
+        int32_t half=TSSqrt(r*r-d*d);
+        spanFB((cx-half+127)>>8,(cx+half-128)>>8,row,color);
+      }
+    }
+  }
+}
+
+/*
+TinyScreen rounded rectangles
+drawRoundRect(x, y, width, height, radius, color);//draw the outline of a rectangle with rounded corners
+fillRoundRect(x, y, width, height, radius, color);//fill a rectangle with rounded corners
+The radius is limited to half the shorter side and to TS_ROUND_RECT_MAX_RADIUS. Rows of the shape that start
+and end at the same place are drawn together, either as a hardware line or rectangle or streamed into one
+window, whichever costs less bus time. A filled shape is drawn as one body across the whole width or as a
+middle rectangle with the corners left to the two sides, whichever works out cheaper.
+With a framebuffer set both draw into the framebuffer instead.
+*/
+
+#ifndef TS_ROUND_RECT_MAX_RADIUS
+#define TS_ROUND_RECT_MAX_RADIUS 32
+#endif
+
+//how far each row of a corner is inset from the side, pixel centers inside the circle are drawn
+static void TSCornerInsets(uint8_t r, uint8_t *inset){
+  for(uint8_t i=0;i<r;i++){
+    int32_t d=2*(r-i)-1;
+    inset[i]=r-((TSSqrt(4*(int32_t)r*r-d*d)+1)>>1);
+  }
+}
+
+static inline uint8_t TSRowInset(const uint8_t *inset, uint8_t r, uint8_t h, uint8_t row){
+  if(row<r)return inset[row];
+  if(row>=h-r)return inset[h-1-row];
+  return 0;
+}
+
+//fill a block with a hardware command or by streaming it into a window, returns the predicted cost
+uint32_t TinyScreen::roundRectBlock(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color, uint8_t draw){
+  if(!clipRect(x0,y0,x1,y1))return 0;
+  if(_frameBuffer){
+    if(draw){
+      for(int16_t y=y0;y<=y1;y++)
+        spanFB(x0,x1,y,color);
+    }
+    return 0;
+  }
+  uint8_t bpp=_bitDepth+1;
+  uint8_t w=x1-x0+1;
+  uint8_t h=y1-y0+1;
+  uint8_t isLine=(w==1||h==1);
+  uint32_t hardwareCost=predictCost(isLine?TSCostLine:TSCostRect,1);
+  uint32_t streamCost=predictCost(TSCostWindow,1)+predictCost(TSCostData,(uint16_t)w*h*bpp);
+  if(!draw)return streamCost<hardwareCost?streamCost:hardwareCost;
+  if(streamCost<hardwareCost){
+    uint8_t *line=TSLineBuffer[0];
+    for(uint8_t i=0;i<w;i++){
+      if(bpp==2)*line++=color>>8;
+      *line++=color;
+    }
+    setWindow(x0,y0,x1,y1);
+    startData();
+    for(uint8_t i=0;i<h;i++)
+      writeBuffer(TSLineBuffer[0],w*bpp);
+    endTransfer();
+    return streamCost;
+  }
+  if(isLine)
+    drawLine(x0,y0,x1,y1,color);
+  else
+    drawRect(x0,y0,w,h,TSRectangleFilled,color);
+  return hardwareCost;
+}
+
+//fill a band of a round rect in groups of rows with the same inset. sides is 1 for the corners on the
+//left, 2 on the right and 3 for both. returns the cost, and only draws if draw is set
+uint32_t TinyScreen::roundRectBand(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t r, const uint8_t *inset, uint8_t sides, uint16_t color, uint8_t draw){
+  uint32_t cost=0;
+  uint8_t row=0;
+  while(row<h){
+    uint8_t in=TSRowInset(inset,r,h,row);
+    uint8_t n=1;
+    while(row+n<h && TSRowInset(inset,r,h,row+n)==in)n++;
+    int16_t x0=x+((sides&1)?in:0);
+    int16_t x1=x+w-1-((sides&2)?in:0);
+    if(x0<=x1)
+      cost+=roundRectBlock(x0,y+row,x1,y+row+n-1,color,draw);
+    row+=n;
+  }
+  return cost;
+}
+
+void TinyScreen::fillRoundRect(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t r, uint16_t color){
+  TS_STAT_CALL(TSStatFillRoundRect);
+  if(!w||!h)return;
+  if(r>w/2)r=w/2;
+  if(r>h/2)r=h/2;
+  if(r>TS_ROUND_RECT_MAX_RADIUS)r=TS_ROUND_RECT_MAX_RADIUS;
+  uint8_t inset[TS_ROUND_RECT_MAX_RADIUS];
+  TSCornerInsets(r,inset);
+  //one body across the whole width, or a middle rectangle with the corners on the sides
+  uint32_t whole=roundRectBand(x,y,w,h,r,inset,3,color,0);
+  uint32_t split=roundRectBand(x,y,r,h,r,inset,1,color,0)+roundRectBand(x+w-r,y,r,h,r,inset,2,color,0);
+  if(w>2*r)split+=roundRectBlock(x+r,y,x+w-1-r,y+h-1,color,0);
+  beginGPIOBatch();
+  if(split<whole){
+    if(w>2*r)roundRectBlock(x+r,y,x+w-1-r,y+h-1,color,1);
+    roundRectBand(x,y,r,h,r,inset,1,color,1);
+    roundRectBand(x+w-r,y,r,h,r,inset,2,color,1);
+  }else{
+    roundRectBand(x,y,w,h,r,inset,3,color,1);
+  }
+  endGPIOBatch();
+}
+
+void TinyScreen::drawRoundRect(int16_t x, int16_t y, uint8_t w, uint8_t h, uint8_t r, uint16_t color){
+  TS_STAT_CALL(TSStatDrawRoundRect);
+  if(!w||!h)return;
+  if(r>w/2)r=w/2;
+  if(r>h/2)r=h/2;
+  if(r>TS_ROUND_RECT_MAX_RADIUS)r=TS_ROUND_RECT_MAX_RADIUS;
+  uint8_t inset[TS_ROUND_RECT_MAX_RADIUS];
+  TSCornerInsets(r,inset);
+  beginGPIOBatch();
+  //top and bottom edges
+  uint8_t edge=TSRowInset(inset,r,h,0);
+  roundRectBlock(x+edge,y,x+w-1-edge,y,color,1);
+  if(h>1)
+    roundRectBlock(x+edge,y+h-1,x+w-1-edge,y+h-1,color,1);
+  //each side row runs from its own inset to just short of the inset of the row nearer the edge,
+  //rows that run the same are drawn together
+  uint8_t row=1;
+  while(row+1<h){
+    uint8_t in=0,out=0,n=0;
+    while(row+n+1<h){
+      uint8_t i=row+n;
+      uint8_t rowIn=TSRowInset(inset,r,h,i);
+      uint8_t edgeIn=TSRowInset(inset,r,h,i<h/2?i-1:i+1);
+      uint8_t rowOut=edgeIn>rowIn+1?edgeIn-1:rowIn;
+      if(n && (rowIn!=in||rowOut!=out))break;
+      in=rowIn;
+      out=rowOut;
+      n++;
+    }
+    roundRectBlock(x+in,y+row,x+out,y+row+n-1,color,1);
+    if(w>1)
+      roundRectBlock(x+w-1-out,y+row,x+w-1-in,y+row+n-1,color,1);
+    row+=n;
+  }
+  endGPIOBatch();
+}
+
+/*
+TinyScreen sprites and tilemap
+Sprites and an optional tilemap background are composed one scanline at a time into a line buffer and
+streamed to the display, so overlapping sprites work without a framebuffer. The sprite table and tilemap
+belong to the sketch- change x, y, z, flags or scroll offsets in them and call drawSprites() again.
+Sprite bitmaps and tiles use the same format as writeBuffer() at the current bit depth, tiles are 8x8
+pixels stored in PROGMEM and indexed by the map in RAM.
+setSprites(table, count);//set the sprite table, up to TS_SPRITE_MAX entries are drawn
+setSpriteBackground(color);//color behind sprites when there is no tilemap, also used to erase rows sprites have left
+setTilemap(tilemap);//set a tilemap to draw behind sprites, call again after changing the map to redraw it all
+drawSprites();//redraw every row that has a sprite on it now or had one last frame, lower z drawn first
+
+When the tilemap scrolls by exactly one tile left or up, the SSD1331 copy command shifts what is already
+on screen and only the new column or row of tiles is streamed, along with the rows sprites are on now or
+were copied to. The controller copies in scan order, so
+shifts the other way could read pixels it has already overwritten- those redraw the whole screen instead.
+*/
+
+#ifndef TS_SPRITE_MAX
+#define TS_SPRITE_MAX 16
+#endif
+
+void TinyScreen::setSprites(TS_SPRITE *sprites, uint8_t count){
+  if(count>TS_SPRITE_MAX)count=TS_SPRITE_MAX;
+  _sprites=sprites;
+  _spriteCount=count;
+  //nothing is known about what is on screen, so the first frame redraws every row
+  memset(_spriteRows,0xFF,sizeof(_spriteRows));
+}
+
+void TinyScreen::setSpriteBackground(uint16_t color){
+  _spriteBackground=color;
+}
+
+void TinyScreen::setTilemap(TS_TILEMAP *tilemap){
+  _tilemap=tilemap;
+  if(_tilemap){
+    _tileScrollX=_tilemap->scrollX;
+    _tileScrollY=_tilemap->scrollY;
+  }
+  memset(_spriteRows,0xFF,sizeof(_spriteRows));
+}
+
+void TinyScreen::composeLine(uint8_t y, uint8_t x0, uint8_t x1, uint8_t *buf, const uint8_t *order, uint8_t count){
+  uint8_t bpp=_bitDepth+1;
+  if(_tilemap && _tilemap->mapWidth && _tilemap->mapHeight){
+    int16_t w=_tilemap->mapWidth*8;
+    int16_t h=_tilemap->mapHeight*8;
+    int16_t py=(y+_tilemap->scrollY)%h;
+    if(py<0)py+=h;
+    int16_t px=(x0+_tilemap->scrollX)%w;
+    if(px<0)px+=w;
+    const uint8_t *mapRow=_tilemap->map+(py>>3)*_tilemap->mapWidth;
+    uint8_t *dst=buf;
+    uint8_t x=x0;
+    while(x<=x1){
+      uint8_t fx=px&7;
+      uint8_t n=8-fx;
+      if(n>x1-x+1)n=x1-x+1;
+      const uint8_t *src=_tilemap->tiles+(mapRow[px>>3]*64+(py&7)*8+fx)*bpp;
+      for(uint8_t i=0;i<n*bpp;i++)
+        *dst++=pgm_read_byte(src+i);
+      x+=n;
+      px+=n;
+      if(px>=w)px=0;
+    }
+  }else if(_bitDepth){
+    for(uint8_t x=0;x<=x1-x0;x++){
+      buf[x*2]=_spriteBackground>>8;
+      buf[x*2+1]=_spriteBackground;
+    }
+  }else{
+    memset(buf,_spriteBackground,x1-x0+1);
+  }
+  for(uint8_t n=0;n<count;n++){
+    const TS_SPRITE *s=&_sprites[order[n]];
+    int16_t row=y-s->y;
+    if(row<0||row>=s->height)continue;
+    int16_t start=0;
+    int16_t end=s->width;
+    if(s->x<x0)start=x0-s->x;
+    if(s->x+end>x1+1)end=x1+1-s->x;
+    if(start>=end)continue;
+    const uint8_t *src=s->bitmap+(row*s->width+start)*bpp;
+    uint8_t *dst=buf+(s->x+start-x0)*bpp;
+    uint8_t keyHi=s->transparentColor>>8;
+    uint8_t keyLo=s->transparentColor;
+    uint8_t progmem=s->flags&TSSpriteProgmem;
+    for(int16_t i=start;i<end;i++){
+      uint8_t hi=0;
+      if(_bitDepth){
+        hi=progmem?pgm_read_byte(src):*src;
+        src++;
+      }
+      uint8_t lo=progmem?pgm_read_byte(src):*src;
+      src++;
+      if(lo!=keyLo || (_bitDepth && hi!=keyHi)){
+        if(_bitDepth)*dst++=hi;
+        *dst++=lo;
+      }else{
+        dst+=bpp;
+      }
+    }
+  }
+}
+
+void TinyScreen::drawSprites(void){
+  TS_STAT_CALL(TSStatDrawSprites);
+  uint8_t order[TS_SPRITE_MAX];
+  uint8_t count=0;
+  uint8_t rows[8];
+  memset(rows,0,sizeof(rows));
+  //insertion sort visible sprites by z, and mark the rows they cover
+  for(uint8_t i=0;i<_spriteCount;i++){
+    const TS_SPRITE *s=&_sprites[i];
+    if(!(s->flags&TSSpriteVisible) || !s->bitmap)continue;
+    uint8_t n=count++;
+    while(n && _sprites[order[n-1]].z>s->z){
+      order[n]=order[n-1];
+      n--;
+    }
+    order[n]=i;
+    int16_t y0=s->y;
+    int16_t y1=s->y+s->height-1;
+    if(y0<0)y0=0;
+    if(y1>yMax)y1=yMax;
+    for(int16_t y=y0;y<=y1;y++)
+      rows[y>>3]|=1<<(y&7);
+  }
+  
+  if(_clipX0>_clipX1||_clipY0>_clipY1)return;
+  //work out how the tilemap moved since the last frame
+  uint8_t redrawAll=0;
+  uint8_t stripX=xMax+1;//first column of a newly uncovered tile column
+  uint8_t stripY=yMax+1;//first row of a newly uncovered tile row
+  if(_tilemap && _tilemap->mapWidth && _tilemap->mapHeight){
+    int16_t w=_tilemap->mapWidth*8;
+    int16_t h=_tilemap->mapHeight*8;
+    int16_t dx=(_tilemap->scrollX-_tileScrollX)%w;
+    int16_t dy=(_tilemap->scrollY-_tileScrollY)%h;
+    if(dx<0)dx+=w;
+    if(dy<0)dy+=h;
+    uint8_t fullScreen=!_clipX0 && !_clipY0 && _clipX1==xMax && _clipY1==yMax;
+    if(!fullScreen && (dx || dy)){
+      //the copy would move pixels outside the clip rectangle
+      redrawAll=1;
+    }else if(dx==8 && dy==0){
+      copyWindow(8,0,xMax,yMax,0,0);
+      stripX=xMax+1-8;
+    }else if(dy==8 && dx==0){
+      copyWindow(0,8,xMax,yMax,0,0);
+      stripY=yMax+1-8;
+      //last frame's sprites moved up a tile row with the copy, those rows need redrawing now
+      memmove(_spriteRows,_spriteRows+1,sizeof(_spriteRows)-1);
+      _spriteRows[sizeof(_spriteRows)-1]=0;
+    }else if(dx || dy){
+      redrawAll=1;
+    }
+    _tileScrollX=_tilemap->scrollX;
+    _tileScrollY=_tilemap->scrollY;
+  }
+  
+  uint8_t bpp=_bitDepth+1;
+  uint8_t buffer=0;
+  uint8_t streaming=0;
+  uint8_t windowX0=0;
+  uint8_t x1=_clipX1;
+  for(uint8_t y=_clipY0;y<=_clipY1;y++){
+    //rows that had nothing on them last frame and have nothing now are left alone
+    uint8_t bit=1<<(y&7);
+    uint8_t x0=_clipX0;
+    if(!redrawAll && y<stripY && !((rows[y>>3]|_spriteRows[y>>3])&bit)){
+      x0=stripX;
+    }
+    if(x0>x1 || (streaming && x0!=windowX0)){
+      if(streaming){
+        while(!getReadyStatusDMA());
+        endTransfer();
+        streaming=0;
+      }
+      if(x0>x1)continue;
+    }
+    composeLine(y,x0,x1,TSLineBuffer[buffer],order,count);
+    if(!streaming){
+      while(!getReadyStatusDMA());
+      setWindow(x0,y,x1,_clipY1);
+      startData();
+      streaming=1;
+      windowX0=x0;
+    }
+    if(_dmaEnabled){
+      writeBufferDMA(TSLineBuffer[buffer],(x1+1-x0)*bpp);
+      buffer^=1;
+    }else{
+      writeBuffer(TSLineBuffer[buffer],(x1+1-x0)*bpp);
+    }
+  }
+  if(streaming){
+    while(!getReadyStatusDMA());
+    endTransfer();
+  }
+  //rows outside the clip rectangle were not drawn, so keep what needs erasing there
+  for(uint8_t y=0;y<=yMax;y++){
+    if(y>=_clipY0 && y<=_clipY1)continue;
+    rows[y>>3]|=_spriteRows[y>>3]&(1<<(y&7));
+  }
+  memcpy(_spriteRows,rows,sizeof(_spriteRows));
+}
+
+/*
+TinyScreen statistics
+Only compiled in when TS_ENABLE_STATS is set to 1 in TinyScreen.h- with it at 0 the hooks expand to nothing.
+getStats();//returns the TS_STATS counters, they can be read or cleared directly
+resetStats();//clear all counters
+printStats(Serial);//print the counters and the calls and time histogram of each function
+Bytes are counted in command or data mode as they go to SPI or are handed to DMA, and spiWaitLoops counts turns
+of the loops waiting for SPI to be ready- loop turns, not CPU cycles, a turn is a few cycles. Calls made from inside other functions count as well, so drawRoundRect() may
+add to the drawRect() and setWindow() counts.
+*/
+
+#if TS_ENABLE_STATS
+
+static const char TSStatNames[] PROGMEM =
+  "drawPixel\0drawLine\0drawRect\0clearWindow\0copyWindow\0setWindow\0writeBuffer\0write\0"
+  "drawKeyedBitmap\0drawRLE\0drawIndexed\0fillGradient\0fillPattern\0drawRoundRect\0fillRoundRect\0"
+  "writeFrameBuffer\0drawSprites\0";
+
+TS_STATS &TinyScreen::getStats(void){
+  return _stats;
+}
+
+void TinyScreen::resetStats(void){
+  memset(&_stats,0,sizeof(_stats));
+}
+
+static void TSPrintStat(Print &out, const char *name, uint32_t value){
+  out.print(name);
+  out.print(": ");
+  out.println(value);
+}
+
+void TinyScreen::printStats(Print &out){
+  TSPrintStat(out,"command bytes",_stats.commandBytes);
+  TSPrintStat(out,"data bytes",_stats.dataBytes);
+  TSPrintStat(out,"transactions",_stats.transactions);
+  TSPrintStat(out,"DC toggles",_stats.dcToggles);
+  TSPrintStat(out,"I2C transactions",_stats.i2cTransactions);
+  TSPrintStat(out,"SPI wait loop turns",_stats.spiWaitLoops);
+  TSPrintStat(out,"hardware commands",_stats.hardwareCommands);
+  TSPrintStat(out,"busy waits",_stats.busyWaits);
+  TSPrintStat(out,"busy wait us",_stats.busyWaitMicros);
+  const char *name=TSStatNames;
+  for(uint8_t api=0;api<TS_STAT_API_COUNT;api++){
+    char c;
+    while((c=pgm_read_byte(name++)))
+      out.write(c);
+    out.print(": ");
+    out.print(_stats.calls[api]);
+    for(uint8_t bucket=0;bucket<TS_STAT_BUCKETS;bucket++){
+      out.print(" ");
+      out.print((uint32_t)_stats.histogram[api][bucket]);
+    }
+    out.println("");
+  }
+}
+
+#endif
+
+/*
+TinyScreen bus trace
+Only compiled in when TS_ENABLE_TRACE is set to 1 in TinyScreen.h. Every byte sent to the SSD1331 is kept in a
+sketch-owned ring buffer with its command or data mode, whether it started a transfer and the microseconds since
+the byte before it. On the shields the SX1505 transactions that drive the control lines and read the buttons are
+kept too, flagged TSTraceGPIO: the register address with TSTraceStart, then the bytes written, or the byte read
+flagged TSTraceRead. When the buffer is full the oldest entries are overwritten and counted as dropped:
+  TS_TRACE_ENTRY entries[256];
+  TS_TRACE trace={entries,256};
+setTrace(trace);//start recording into trace, or 0 to stop
+writeTrace(Serial);//write the recorded entries, oldest first, in the binary format read by extras/hostbench/tracereplay, and empty the buffer
+With stream set in the TS_TRACE, entries are written to it as they are recorded instead, for traces longer than a
+buffer- the stream has to be given the 16 byte header first, with the count filled in later or left at 0xFFFFFFFF.
+Calling micros() for each byte slows transfers down, so timings in a trace are longer than without it.
+The format is "TSTR", a version byte of 2, three zero bytes, the entry count and dropped count as 32 bit little
+endian values, then four bytes per entry: delta low byte, delta high byte, data, flags. Version 1 had no GPIO entries.
+*/
+
+#if TS_ENABLE_TRACE
+
+void TinyScreen::setTrace(TS_TRACE *trace){
+  _trace=trace;
+  if(_trace)
+    _trace->lastTime=micros();
+}
+
+void TinyScreen::traceByte(uint8_t data){
+  if(!_trace || (!_trace->size && !_trace->stream))return;
+  TS_TRACE &trace=*_trace;
+  uint32_t now=micros();
+  uint32_t delta=now-trace.lastTime;
+  trace.lastTime=now;
+  if(trace.stream){
+    if(delta>0xFFFF)delta=0xFFFF;
+    const uint8_t bytes[4]={(uint8_t)delta,(uint8_t)(delta>>8),data,_traceFlags};
+    trace.stream->write(bytes,sizeof(bytes));
+    _traceFlags&=~TSTraceStart;
+    return;
+  }
+  TS_TRACE_ENTRY &entry=trace.entries[trace.head];
+  entry.delta=delta>0xFFFF?0xFFFF:delta;
+  entry.data=data;
+  entry.flags=_traceFlags;
+  _traceFlags&=~TSTraceStart;
+  if(++trace.head==trace.size)trace.head=0;
+  if(trace.count<trace.size)
+    trace.count++;
+  else
+    trace.dropped++;
+}
+
+//an SX1505 byte, recorded without touching the flags of the SSD1331 transfer it may be part of
+void TinyScreen::traceGPIO(uint8_t data, uint8_t flags){
+  uint8_t spiFlags=_traceFlags;
+  _traceFlags=TSTraceGPIO|flags;
+  traceByte(data);
+  _traceFlags=spiFlags;
+}
+
+static void TSWrite32(Print &out, uint32_t value){
+  for(uint8_t i=0;i<4;i++)
+    out.write((uint8_t)(value>>(i*8)));
+}
+
+void TinyScreen::writeTrace(Print &out){
+  if(!_trace)return;
+  TS_TRACE &trace=*_trace;
+  const uint8_t header[8]={'T','S','T','R',2,0,0,0};
+  out.write(header,sizeof(header));
+  TSWrite32(out,trace.count);
+  TSWrite32(out,trace.dropped);
+  uint16_t i=trace.head>=trace.count?trace.head-trace.count:trace.head+trace.size-trace.count;
+  for(uint16_t n=0;n<trace.count;n++){
+    const TS_TRACE_ENTRY &entry=trace.entries[i];
+    const uint8_t bytes[4]={(uint8_t)entry.delta,(uint8_t)(entry.delta>>8),entry.data,entry.flags};
+    out.write(bytes,sizeof(bytes));
+    if(++i==trace.size)i=0;
+  }
+  trace.count=0;
+  trace.dropped=0;
+}
+
+#endif
+
 /*
 TinyScreen+ SAMD21 DMA write
 Example code taken from https://github.com/manitou48/ZERO/blob/master/SPIdma.ino
@@ -649,6 +3005,12 @@ uint8_t TinyScreen::getReadyStatusDMA(){
 
 void TinyScreen::writeBufferDMA(uint8_t *txdata,int n) {
 #if defined(ARDUINO_ARCH_SAMD)
+  //DMA bytes do not go through the byte hooks
+  TS_STAT_ADD(dataBytes,n);
+#if TS_ENABLE_TRACE
+  for(int i=0;i<n;i++)
+    traceByte(txdata[i]);
+#endif
   while(!dmaReady);
   
   uint32_t temp_CHCTRLB_reg;
@@ -691,6 +3053,29 @@ void TinyScreen::writeBufferDMA(uint8_t *txdata,int n) {
 #endif
 }
 
+void TinyScreen::writeBuffer16DMA(const uint16_t *buffer,int count) {
+  if(!_dmaEnabled){
+    writeBuffer16(buffer,count);
+    return;
+  }
+  //swap a line at a time into one line buffer while the other is sent
+  uint8_t b=0;
+  while(count>0){
+    int n=count>xMax+1?xMax+1:count;
+    uint8_t *line=TSLineBuffer[b];
+    for(int i=0;i<n;i++){
+      uint16_t color=buffer[i];
+      line[i*2]=color>>8;
+      line[i*2+1]=color;
+    }
+    writeBufferDMA(line,n*2);
+    buffer+=n;
+    count-=n;
+    b^=1;
+  }
+  while(!getReadyStatusDMA());
+}
+
 void TinyScreen::initDMA(void){
 #if defined(ARDUINO_ARCH_SAMD)
   //probably on by default
@@ -701,6 +3086,7 @@ void TinyScreen::initDMA(void){
   DMAC->BASEADDR.reg = (uint32_t)descriptor_section;
   DMAC->WRBADDR.reg = (uint32_t)wrb;
   DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xf);
+  _dmaEnabled=1;
 #else
   //it's tough to raise an error about not having DMA in the IDE- try to fall back to regular software transfer
   //ignore init
@@ -56,6 +56,14 @@ const uint16_t TS_16b_Brown     = 0x0C10;
 const uint16_t TS_16b_DarkBrown = 0x0810;
 const uint16_t TS_16b_Yellow    = 0x07FF;
 
+// Colors from 8 bit red, green and blue channels, usable in constant expressions and template arguments
+constexpr uint8_t TS_RGB8(uint8_t r, uint8_t g, uint8_t b){return (b&0xE0)|((g>>3)&0x1C)|(r>>6);}
+constexpr uint16_t TS_RGB16(uint8_t r, uint8_t g, uint8_t b){return ((uint16_t)(b>>3)<<11)|((uint16_t)(g>>2)<<5)|(r>>3);}
+
+// 8b to 16b with the high bits of each channel copied into the low bits, and back
+constexpr uint16_t TS_8bTo16b(uint8_t c){return ((uint16_t)(((c>>5)<<2)|(c>>6))<<11)|((uint16_t)((((c>>2)&7)<<3)|((c>>2)&7))<<5)|(((c&3)<<3)|((c&3)<<1)|((c&3)>>1));}
+constexpr uint8_t TS_16bTo8b(uint16_t c){return ((c>>8)&0xE0)|((c>>6)&0x1C)|((c>>3)&0x03);}
+
 // TinyScreen types
 const uint8_t TinyScreenDefault   = 0;
 const uint8_t TinyScreenAlternate = 1;
@@ -69,6 +77,33 @@ const uint8_t TSRectangleNoFill = 0;
 const uint8_t TSBitDepth8  = 0;
 const uint8_t TSBitDepth16 = 1;
 
+// TinyScreen pixel formats for buffer conversion
+const uint8_t TSFormat8b     = 0;//BBBGGGRR bytes, the same as TSBitDepth8
+const uint8_t TSFormat16b    = 1;//uint16_t BBBBBGGGGGGRRRRR pixels, the same as TSBitDepth16
+const uint8_t TSFormatRGB888 = 2;//three bytes per pixel, red first
+
+// TinyScreen dither modes for 8 bit output
+const uint8_t TSDitherNone      = 0;
+const uint8_t TSDitherOrdered   = 1;
+const uint8_t TSDitherDiffusion = 2;
+
+// TinyScreen gradient directions
+const uint8_t TSGradientHorizontal = 0;
+const uint8_t TSGradientVertical   = 1;
+
+// TinyScreen fill patterns, 8x8 pixels with one byte per row
+const uint8_t TSPatternChecker[8]        = {0xAA,0x55,0xAA,0x55,0xAA,0x55,0xAA,0x55};
+const uint8_t TSPatternDots[8]           = {0x88,0x00,0x22,0x00,0x88,0x00,0x22,0x00};
+const uint8_t TSPatternHatchDiagonal[8]  = {0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x01};
+const uint8_t TSPatternHatchCross[8]     = {0x81,0x42,0x24,0x18,0x18,0x24,0x42,0x81};
+const uint8_t TSPatternHatchHorizontal[8]= {0xFF,0x00,0x00,0x00,0xFF,0x00,0x00,0x00};
+const uint8_t TSPatternHatchVertical[8]  = {0x88,0x88,0x88,0x88,0x88,0x88,0x88,0x88};
+
+// TinyScreen line caps
+const uint8_t TSLineCapButt   = 0;
+const uint8_t TSLineCapSquare = 1;
+const uint8_t TSLineCapRound  = 2;
+
 // TinyScreen Color Modes
 const uint8_t TSColorModeBGR = 0;
 const uint8_t TSColorModeRGB = 1;
@@ -130,9 +165,189 @@ typedef struct
 		
 } FONT_INFO;	
 
+// TinyScreen sprite flags
+const uint8_t TSSpriteVisible = 0x01;
+const uint8_t TSSpriteProgmem = 0x02;
+
+typedef struct
+{
+	int16_t x;
+	int16_t y;
+	uint8_t width;
+	uint8_t height;
+	const uint8_t *bitmap;
+	uint16_t transparentColor;
+	uint8_t z;
+	uint8_t flags;
+	
+} TS_SPRITE;
+
+// TinyScreen color keyed bitmap flags
+const uint8_t TSKeyedProgmem  = 0x02;
+const uint8_t TSKeyedOverdraw = 0x04;
+
+typedef struct
+{
+	const uint8_t *bitmap;
+	uint8_t width;
+	uint8_t height;
+	uint16_t transparentColor;
+	uint8_t flags;
+	uint8_t *runs;
+	uint16_t runsSize;
+	uint16_t runsUsed;
+	uint8_t runsBpp;//bytes per pixel the runs were worked out for, 0 to work them out again
+	
+} TS_KEYED_BITMAP;
+
+typedef struct
+{
+	const uint8_t *tiles;
+	uint8_t *map;
+	uint8_t mapWidth;
+	uint8_t mapHeight;
+	int16_t scrollX;
+	int16_t scrollY;
+	
+} TS_TILEMAP;
+
+// TinyScreen button event types
+const uint8_t TSButtonPress     = 0;
+const uint8_t TSButtonRelease   = 1;
+const uint8_t TSButtonLongPress = 2;
+const uint8_t TSButtonRepeat    = 3;
+
+typedef struct
+{
+	uint32_t time;
+	uint8_t button;
+	uint8_t type;
+	
+} TS_BUTTON_EVENT;
+
+typedef struct
+{
+	volatile TS_BUTTON_EVENT *events;
+	uint8_t size;
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	uint8_t raw;
+	uint8_t stable;
+	uint8_t held;
+	uint16_t rawTime;
+	uint16_t nextTime[4];
+	
+} TS_BUTTON_QUEUE;
+
+// TinyScreen cost model operations, see predictCost()
+const uint8_t TSCostTransfer = 0;//a startCommand() or startData() and its endTransfer()
+const uint8_t TSCostData     = 1;//bytes streamed inside a transfer
+const uint8_t TSCostWindow   = 2;//setWindow() and starting the data transfer after it
+const uint8_t TSCostRect     = 3;//a hardware rectangle, clear or copy, with the wait for it
+const uint8_t TSCostLine     = 4;//a hardware line, with the wait for it
+
+typedef struct
+{
+	uint32_t spiHz;//SPI clock set in begin()
+	uint32_t i2cHz;//I2C clock of the SX1505 GPIO writes, 0 when the control lines are direct IO
+	uint16_t pinNanos;//time to change a direct IO control line
+	uint16_t byteNanos;//CPU time per byte on top of the SPI clock
+	uint16_t rectMicros;//SSD1331 time for a rectangle, clear or copy
+	uint16_t lineMicros;//SSD1331 time for a line
+	
+} TS_COST_MODEL;
+
+// Set to 1 to count bus traffic and time drawing calls, see getStats(). When 0 none of it is compiled in
+// It adds class members, so it is only set here
+#define TS_ENABLE_STATS 0
+
+#if TS_ENABLE_STATS
+// TinyScreen statistics, calls and histograms are kept for each of these
+const uint8_t TSStatDrawPixel        = 0;
+const uint8_t TSStatDrawLine         = 1;
+const uint8_t TSStatDrawRect         = 2;
+const uint8_t TSStatClearWindow      = 3;
+const uint8_t TSStatCopyWindow       = 4;
+const uint8_t TSStatSetWindow        = 5;
+const uint8_t TSStatWriteBuffer      = 6;
+const uint8_t TSStatWrite            = 7;
+const uint8_t TSStatDrawKeyedBitmap  = 8;
+const uint8_t TSStatDrawRLE          = 9;
+const uint8_t TSStatDrawIndexed      = 10;
+const uint8_t TSStatFillGradient     = 11;
+const uint8_t TSStatFillPattern      = 12;
+const uint8_t TSStatDrawRoundRect    = 13;
+const uint8_t TSStatFillRoundRect    = 14;
+const uint8_t TSStatWriteFrameBuffer = 15;
+const uint8_t TSStatDrawSprites      = 16;
+const uint8_t TS_STAT_API_COUNT      = 17;
+// histogram bucket n counts calls that took 2^n to 2^(n+1)-1 microseconds, the last one everything longer
+const uint8_t TS_STAT_BUCKETS        = 12;
+
+typedef struct
+{
+	uint32_t commandBytes;
+	uint32_t dataBytes;
+	uint32_t transactions;
+	uint32_t dcToggles;
+	uint32_t i2cTransactions;
+	uint32_t spiWaitLoops;
+	uint32_t hardwareCommands;
+	uint32_t busyWaits;
+	uint32_t busyWaitMicros;
+	uint32_t calls[TS_STAT_API_COUNT];
+	uint16_t histogram[TS_STAT_API_COUNT][TS_STAT_BUCKETS];
+	
+} TS_STATS;
+#endif
+
+// Set to 1 to record every byte sent to the SSD1331 and the SX1505 into a TS_TRACE ring buffer, see setTrace(). When 0
+// none of it is compiled in. The class layout is the same either way
+#ifndef TS_ENABLE_TRACE
+#define TS_ENABLE_TRACE 0
+#endif
+
+// TinyScreen trace entry flags
+const uint8_t TSTraceData  = 0x01;//sent in data mode, command mode otherwise
+const uint8_t TSTraceStart = 0x02;//first byte after chip select went active, or first byte of an I2C transaction
+const uint8_t TSTraceGPIO  = 0x04;//register address or data byte of an SX1505 transaction
+const uint8_t TSTraceRead  = 0x08;//byte read back from the SX1505
+
+typedef struct
+{
+	uint16_t delta;//microseconds since the previous entry, 0xFFFF for longer
+	uint8_t data;
+	uint8_t flags;
+	
+} TS_TRACE_ENTRY;
+
+typedef struct
+{
+	TS_TRACE_ENTRY *entries;
+	uint16_t size;
+	uint16_t head;
+	uint16_t count;
+	uint32_t dropped;
+	uint32_t lastTime;
+	Print *stream;//when set, entries are written here as they are recorded instead of kept in entries
+	
+} TS_TRACE;
+
 //#include <avr/pgmspace.h>
 #include "font.h"
 
+// Number of clip rectangles pushClip() can save. It sizes a class member, so it is only set here
+#define TS_CLIP_STACK_DEPTH 4
+
+// default microseconds the OLED supply needs after the boost converter is turned on, before the display is
+// turned on. Sketches change it with setSettleTime(), a define in a sketch does not reach TinyScreen.cpp
+#ifndef TS_BOOST_SETTLE_MICROS
+#define TS_BOOST_SETTLE_MICROS 10000
+#endif
+#if TS_BOOST_SETTLE_MICROS > 65535
+#error TS_BOOST_SETTLE_MICROS must be 65535 or less
+#endif
+
 class TinyScreen : public Print {
  public:
   //init, control
@@ -143,52 +358,178 @@ class TinyScreen : public Print {
   void begin(void);
   void on(void);
   void off(void);
+  void sleep(void);
+  void resume(void);
+  void setSettleTime(uint16_t);
   void setFlip(uint8_t);
   void setMirror(uint8_t);
   void setBitDepth(uint8_t);
   void setColorMode(uint8_t);
   void setBrightness(uint8_t);
+  void setContrast(uint8_t, uint8_t, uint8_t);
+  void setPrecharge(uint8_t, uint8_t, uint8_t);
+  void setGrayscaleTable(const uint8_t *);
+  void setGamma(float);
+  void setLinearGrayscale(void);
   void writeRemap(void);
+  uint8_t getReadyStatus(void);
+  void waitReady(void);
+  //cost model
+  void setCostModel(const TS_COST_MODEL &);
+  const TS_COST_MODEL &getCostModel(void);
+  uint32_t predictCost(uint8_t, uint32_t);
+  //clipping
+  void setClipRect(int16_t, int16_t, int16_t, int16_t);
+  uint8_t pushClip(int16_t, int16_t, int16_t, int16_t);
+  void popClip(void);
   //accelerated drawing commands
-  void drawPixel(uint8_t, uint8_t, uint16_t);
-  void drawLine(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t);
-  void drawLine(uint8_t, uint8_t, uint8_t, uint8_t, uint16_t);
-  void drawRect(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t);
-  void drawRect(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint16_t);
-  void clearWindow(uint8_t, uint8_t, uint8_t, uint8_t);
+  void drawPixel(int16_t, int16_t, uint16_t);
+  void drawLine(int16_t, int16_t, int16_t, int16_t, uint8_t, uint8_t, uint8_t);
+  void drawLine(int16_t, int16_t, int16_t, int16_t, uint16_t);
+  void drawRect(int16_t, int16_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t);
+  void drawRect(int16_t, int16_t, uint8_t, uint8_t, uint8_t, uint16_t);
+  void clearWindow(int16_t, int16_t, uint8_t, uint8_t);
   void clearScreen(void);
+  void copyWindow(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t);
+  void drawRoundRect(int16_t, int16_t, uint8_t, uint8_t, uint8_t, uint16_t);
+  void fillRoundRect(int16_t, int16_t, uint8_t, uint8_t, uint8_t, uint16_t);
   //basic graphics commands
   void writePixel(uint16_t);
   void writeBuffer(const uint8_t *, int);
+  void writeBuffer16(const uint16_t *, int);
+  void writeBuffer(const void *, int, uint8_t);
+  void convertBuffer(const void *, uint8_t, void *, uint8_t, uint16_t);
+  //dithering
+  void setDither(uint8_t);
+  void ditherRow(const void *, uint8_t, uint8_t *, uint8_t, int16_t, int16_t);
+  void writeDitheredRow(const void *, uint8_t, uint8_t, int16_t, int16_t);
   void setX(uint8_t, uint8_t);
   void setY(uint8_t, uint8_t);
   void goTo(uint8_t x, uint8_t y);
+  void setWindow(uint8_t, uint8_t, uint8_t, uint8_t);
+  //color keyed bitmaps
+  uint8_t buildKeyedRuns(TS_KEYED_BITMAP &);
+  void drawKeyedBitmap(int16_t, int16_t, TS_KEYED_BITMAP &);
   //I2C GPIO related
   uint8_t getButtons(uint8_t);
   uint8_t getButtons(void);
-  void writeGPIO(uint8_t, uint8_t);
+  void enableButtonInterrupts(uint8_t);
+  void disableButtonInterrupts(void);
+  void setButtonQueue(TS_BUTTON_QUEUE *);
+  void serviceButtons(void);
+  uint8_t getButtonEvent(TS_BUTTON_EVENT &);
+  uint8_t writeGPIO(uint8_t, uint8_t);
+  uint8_t writeGPIO(uint8_t, const uint8_t *, uint8_t);
+  uint8_t readGPIO(uint8_t);
+  void beginGPIOBatch(void);
+  void endGPIOBatch(void);
   //font
   void setFont(const FONT_INFO&);
   uint8_t getFontHeight(const FONT_INFO&);
   uint8_t getFontHeight(void);
   uint8_t getPrintWidth(char *);
-  void setCursor(uint8_t, uint8_t);
+  void setCursor(int16_t, int16_t);
   void fontColor(uint16_t, uint16_t);
   virtual size_t write(uint8_t);
+  //RLE images
+  void drawRLE(int16_t, int16_t, const uint8_t *);
+  //indexed color bitmaps
+  void drawIndexed(int16_t, int16_t, uint8_t, uint8_t, uint8_t, const uint8_t *, const uint16_t *);
+  //streamed fills
+  void fillGradient(int16_t, int16_t, uint8_t, uint8_t, uint8_t, uint16_t, uint16_t);
+  void fillGradient(int16_t, int16_t, uint8_t, uint8_t, uint8_t, const uint16_t *, uint8_t);
+  void fillPattern(int16_t, int16_t, uint8_t, uint8_t, const uint8_t *, uint16_t, uint16_t);
+  //framebuffer
+  void setFrameBuffer(void *);
+  void writeFrameBuffer(void);
+  void blitAlpha(int16_t, int16_t, uint8_t, uint8_t, const uint8_t *, uint8_t);
+  void blitAlpha(int16_t, int16_t, uint8_t, uint8_t, const uint16_t *, uint8_t);
+  void blitAlphaMask(int16_t, int16_t, uint8_t, uint8_t, const uint8_t *, const uint8_t *);
+  void blitAlphaMask(int16_t, int16_t, uint8_t, uint8_t, const uint16_t *, const uint8_t *);
+  void fillAlpha(int16_t, int16_t, uint8_t, uint8_t, uint16_t, uint8_t);
+  void drawLineAA(int16_t, int16_t, int16_t, int16_t, uint16_t);
+  void drawThickLine(int16_t, int16_t, int16_t, int16_t, uint8_t, uint8_t, uint16_t);
+  //sprites
+  void setSprites(TS_SPRITE *, uint8_t);
+  void setSpriteBackground(uint16_t);
+  void setTilemap(TS_TILEMAP *);
+  void drawSprites(void);
+#if TS_ENABLE_STATS
+  //statistics
+  TS_STATS &getStats(void);
+  void resetStats(void);
+  void printStats(Print &);
+#endif
+#if TS_ENABLE_TRACE
+  //bus trace
+  void setTrace(TS_TRACE *);
+  void writeTrace(Print &);
+#endif
   //DMA for SAMD
   void initDMA(void);
   uint8_t getReadyStatusDMA(void);
   void writeBufferDMA(uint8_t *,int);
+  void writeBuffer16DMA(const uint16_t *,int);
   
   static const uint8_t xMax=95;
   static const uint8_t yMax=63;
  private:
   
-  uint8_t _addr, _cursorX, _cursorY, _fontHeight, _fontFirstCh, _fontLastCh, _bitDepth, _flipDisplay, _mirrorDisplay, _colorMode, _externalIO, _type;
-  uint16_t  _fontColor, _fontBGcolor;
+  int16_t _cursorX, _cursorY;
+  uint8_t _addr, _fontHeight, _fontFirstCh, _fontLastCh, _bitDepth, _flipDisplay, _mirrorDisplay, _colorMode, _externalIO, _type, _dmaEnabled;
+  uint16_t  _fontColor, _fontBGcolor, _busyTime;
+  uint32_t _busyStart;
   const FONT_CHAR_INFO* _fontDescriptor;
   const unsigned char* _fontBitmap;
+  void *_frameBuffer;
+  TS_SPRITE *_sprites;
+  uint8_t _spriteCount, _spriteRows[8];
+  uint16_t _spriteBackground;
+  TS_TILEMAP *_tilemap;
+  int16_t _tileScrollX, _tileScrollY;
+  uint8_t _ditherMode;
+  int16_t _ditherNextY;
+  uint8_t _buttonInterrupts, _buttonInterruptPin, _buttonState, _buttonChangesSeen;
+  TS_BUTTON_QUEUE *_buttonQueue;
+  TS_COST_MODEL _costModel;
+  uint32_t _byteNanos, _transferNanos;
+  uint16_t _settleMicros;
+  uint8_t _wakePending;
+  uint8_t _gpioAddr, _gpioBatch, _gpioHeld, _gpioRawFailed;
+  volatile uint8_t _gpioBusy;
+#if TS_ENABLE_STATS
+  TS_STATS _stats;
+  uint8_t _statDataMode;
+#endif
+  TS_TRACE *_trace;
+  uint8_t _traceFlags;
+#if TS_ENABLE_TRACE
+  void traceByte(uint8_t);
+  void traceGPIO(uint8_t, uint8_t);
+#endif
+#if defined(ARDUINO_ARCH_SAMD)
+  volatile uint32_t *_dcSet, *_dcClear, *_csSet, *_csClear;
+  uint32_t _dcMask, _csMask;
+#endif
   SPIClass *TSSPI;
+  uint8_t _clipX0, _clipY0, _clipX1, _clipY1, _clipDepth, _clipStack[TS_CLIP_STACK_DEPTH][4];
+  void setBusy(uint16_t);
+  uint8_t readButtons(void);
+  uint8_t flipButtons(uint8_t);
+  uint8_t clipRect(int16_t &, int16_t &, int16_t &, int16_t &);
+  uint8_t clipLine(int16_t &, int16_t &, int16_t &, int16_t &);
+  uint8_t clipBlit(int16_t &, int16_t &, int16_t &, int16_t &, int16_t &, int16_t &);
+  void writeBufferPGM(const uint8_t *, int);
+  void colorToRGB6(uint16_t, uint8_t &, uint8_t &, uint8_t &);
+  uint16_t RGB6ToColor(uint8_t, uint8_t, uint8_t);
+  void blendPixelFB(int16_t, int16_t, uint16_t, uint8_t);
+  void spanFB(int16_t, int16_t, int16_t, uint16_t);
+  uint32_t roundRectBlock(int16_t, int16_t, int16_t, int16_t, uint16_t, uint8_t);
+  uint32_t roundRectBand(int16_t, int16_t, uint8_t, uint8_t, uint8_t, const uint8_t *, uint8_t, uint16_t, uint8_t);
+  void gradientLine(const uint16_t *, uint8_t, uint16_t, uint16_t, uint16_t, uint8_t *);
+  void drawKeyedRun(int16_t, int16_t, const TS_KEYED_BITMAP &, uint8_t, uint8_t, uint8_t, uint8_t);
+  uint8_t keyedOverdraw(uint8_t, uint16_t, uint8_t);
+  void composeLine(uint8_t, uint8_t, uint8_t, uint8_t *, const uint8_t *, uint8_t);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,269 @@
+/*
+  TinyScreen/TinyScreen+ Benchmark
+
+  This example times each drawing function in a loop and prints ops/sec and
+  effective bytes/sec to the serial monitor, at 8 and 16 bit depth. Effective
+  bytes are the pixel bytes an operation changes on screen, so hardware
+  commands, streamed pixels and DMA can be compared directly when choosing a
+  bit depth and transfer path for a project.
+
+  Set BENCHMARK_BOARD to the board the sketch is running on and open the
+  serial monitor at 115200 baud. Results are printed as comma separated lines:
+  board,depth,test,ops/s,bytes/s
+
+  https://TinyCircuits.com
+*/
+
+#include <Wire.h>
+#include <SPI.h>
+#include <TinyScreen.h>
+
+//TinyScreenDefault, TinyScreenAlternate or TinyScreenPlus
+#define BENCHMARK_BOARD TinyScreenPlus
+TinyScreen display = TinyScreen(BENCHMARK_BOARD);
+
+#if defined(ARDUINO_ARCH_SAMD)
+#define SerialMonitor SerialUSB
+#else
+#define SerialMonitor Serial
+#endif
+
+const unsigned long testTime = 1000; //ms each test runs for
+
+//16x16 one bit per pixel image for drawIndexed
+const uint8_t indexedBitmap[32] PROGMEM = {
+  0x07, 0xE0, 0x18, 0x18, 0x20, 0x04, 0x40, 0x02, 0x4C, 0x32, 0x8C, 0x31, 0x80, 0x01, 0x80, 0x01,
+  0x80, 0x01, 0x88, 0x11, 0x44, 0x22, 0x43, 0xC2, 0x20, 0x04, 0x18, 0x18, 0x07, 0xE0, 0x00, 0x00
+};
+
+uint8_t depth = TSBitDepth8;
+uint8_t bytesPerPixel = 1;
+uint8_t lineBuffer[96 * 2];
+uint16_t lineBuffer16[96];
+uint16_t palette[2];
+#if defined(ARDUINO_ARCH_SAMD)
+uint8_t frameBuffer[96 * 64 * 2];
+#endif
+
+typedef void (*BenchmarkOp)(unsigned long);
+
+//8 bit colors are converted when running at 16 bit depth
+uint16_t color(uint8_t color8) {
+  if (depth == TSBitDepth16)
+    return TS_8bTo16b(color8);
+  return color8;
+}
+
+void setup(void) {
+  Wire.begin();
+  SerialMonitor.begin(115200);
+  while (!SerialMonitor && millis() < 5000);
+  display.begin();
+  display.setBrightness(10);
+#if defined(ARDUINO_ARCH_SAMD)
+  display.initDMA();
+#endif
+}
+
+void loop() {
+  SerialMonitor.println("board,depth,test,ops/s,bytes/s");
+  runAll(TSBitDepth8);
+  runAll(TSBitDepth16);
+  display.setBitDepth(TSBitDepth8);
+  display.clearScreen();
+  display.setFont(thinPixel7_10ptFontInfo);
+  display.fontColor(TS_8b_White, TS_8b_Black);
+  display.setCursor(0, 0);
+  display.print("Benchmark done");
+  while (1);
+}
+
+void runAll(uint8_t bitDepth) {
+  depth = bitDepth;
+  bytesPerPixel = bitDepth + 1;
+  display.setBitDepth(bitDepth);
+  for (uint8_t i = 0; i < 96; i++) {
+    uint16_t c = color(i * 2);
+    lineBuffer16[i] = c;
+    if (depth == TSBitDepth16) {
+      lineBuffer[i * 2] = c >> 8;
+      lineBuffer[i * 2 + 1] = c;
+    } else {
+      lineBuffer[i] = c;
+    }
+  }
+  palette[0] = color(TS_8b_Black);
+  palette[1] = color(TS_8b_Yellow);
+
+  runTest("drawPixel", pixelOp, 1);
+  runTest("drawLine", lineOp, 96);
+  runTest("drawRect", rectOp, 32 * 4 - 4);
+  runTest("drawRect filled", filledRectOp, 32 * 32);
+  runTest("clearWindow", clearWindowOp, 32 * 32);
+  runTest("copyWindow", copyWindowOp, 48 * 32);
+  runTest("drawRoundRect", roundRectOp, 32 * 4);
+  runTest("fillRoundRect", fillRoundRectOp, 32 * 32);
+  runTest("fillGradient", gradientOp, 32 * 32);
+  runTest("fillPattern", patternOp, 32 * 32);
+  runTest("drawIndexed", indexedOp, 16 * 16);
+  runTextTest("text thinPixel7 10pt", thinPixel7_10ptFontInfo);
+  runTextTest("text 8pt", liberationSans_8ptFontInfo);
+  runTextTest("text 10pt", liberationSans_10ptFontInfo);
+  runTextTest("text 12pt", liberationSans_12ptFontInfo);
+  runTextTest("text 14pt", liberationSans_14ptFontInfo);
+  runTextTest("text 16pt", liberationSans_16ptFontInfo);
+  runTextTest("text 22pt", liberationSans_22ptFontInfo);
+  runTest("writeBuffer", writeBufferOp, 96 * 64);
+  if (depth == TSBitDepth16)
+    runTest("writeBuffer16", writeBuffer16Op, 96 * 64);
+#if defined(ARDUINO_ARCH_SAMD)
+  runTest("writeBufferDMA", writeBufferDMAOp, 96 * 64);
+  if (depth == TSBitDepth16)
+    runTest("writeBuffer16DMA", writeBuffer16DMAOp, 96 * 64);
+  display.setFrameBuffer(frameBuffer);
+  runTest("writeFrameBuffer", frameBufferOp, 96 * 64);
+  display.setFrameBuffer(0);
+#endif
+}
+
+//run op in batches until testTime has passed, then print the rates
+void runTest(const char *name, BenchmarkOp op, unsigned long pixelsPerOp) {
+  display.clearScreen();
+  unsigned long ops = 0;
+  unsigned long start = millis();
+  unsigned long elapsed;
+  do {
+    for (uint8_t i = 0; i < 8; i++)
+      op(ops++);
+    elapsed = millis() - start;
+  } while (elapsed < testTime);
+  printResult(name, ops, pixelsPerOp * bytesPerPixel, elapsed);
+}
+
+void printResult(const char *name, unsigned long ops, unsigned long bytesPerOp, unsigned long elapsed) {
+  unsigned long opsPerSecond = ops * 1000 / elapsed;
+  if (BENCHMARK_BOARD == TinyScreenPlus)
+    SerialMonitor.print("TinyScreen+,");
+  else if (BENCHMARK_BOARD == TinyScreenAlternate)
+    SerialMonitor.print("TinyScreenAlternate,");
+  else
+    SerialMonitor.print("TinyScreen,");
+  SerialMonitor.print(depth == TSBitDepth16 ? 16 : 8);
+  SerialMonitor.print(',');
+  SerialMonitor.print(name);
+  SerialMonitor.print(',');
+  SerialMonitor.print(opsPerSecond);
+  SerialMonitor.print(',');
+  SerialMonitor.println(opsPerSecond * bytesPerOp);
+}
+
+void pixelOp(unsigned long i) {
+  display.drawPixel(i % 96, (i / 96) % 64, color(i));
+}
+
+void lineOp(unsigned long i) {
+  display.drawLine(0, i % 64, 95, 63 - i % 64, color(i));
+}
+
+void rectOp(unsigned long i) {
+  display.drawRect(i % 64, i % 32, 32, 32, TSRectangleNoFill, color(i));
+}
+
+void filledRectOp(unsigned long i) {
+  display.drawRect(i % 64, i % 32, 32, 32, TSRectangleFilled, color(i));
+}
+
+void clearWindowOp(unsigned long i) {
+  display.clearWindow(i % 64, i % 32, 32, 32);
+}
+
+void copyWindowOp(unsigned long i) {
+  display.copyWindow(0, 0, 47, 31, 48, 32);
+}
+
+void roundRectOp(unsigned long i) {
+  display.drawRoundRect(i % 64, i % 32, 32, 32, 6, color(i));
+}
+
+void fillRoundRectOp(unsigned long i) {
+  display.fillRoundRect(i % 64, i % 32, 32, 32, 6, color(i));
+}
+
+void gradientOp(unsigned long i) {
+  display.fillGradient(i % 64, i % 32, 32, 32, TSGradientVertical, color(TS_8b_Blue), color(i));
+}
+
+void patternOp(unsigned long i) {
+  display.fillPattern(i % 64, i % 32, 32, 32, TSPatternChecker, color(i), color(TS_8b_Black));
+}
+
+void indexedOp(unsigned long i) {
+  display.drawIndexed(i % 80, i % 48, 16, 16, 1, indexedBitmap, palette);
+}
+
+void writeBufferOp(unsigned long i) {
+  display.setX(0, 95);
+  display.setY(0, 63);
+  display.startData();
+  for (uint8_t y = 0; y < 64; y++)
+    display.writeBuffer(lineBuffer, 96 * bytesPerPixel);
+  display.endTransfer();
+}
+
+void writeBuffer16Op(unsigned long i) {
+  display.setX(0, 95);
+  display.setY(0, 63);
+  display.startData();
+  for (uint8_t y = 0; y < 64; y++)
+    display.writeBuffer16(lineBuffer16, 96);
+  display.endTransfer();
+}
+
+#if defined(ARDUINO_ARCH_SAMD)
+void writeBufferDMAOp(unsigned long i) {
+  display.setX(0, 95);
+  display.setY(0, 63);
+  display.startData();
+  for (uint8_t y = 0; y < 64; y++)
+    display.writeBufferDMA(lineBuffer, 96 * bytesPerPixel);
+  while (!display.getReadyStatusDMA());
+  display.endTransfer();
+}
+
+void writeBuffer16DMAOp(unsigned long i) {
+  display.setX(0, 95);
+  display.setY(0, 63);
+  display.startData();
+  for (uint8_t y = 0; y < 64; y++)
+    display.writeBuffer16DMA(lineBuffer16, 96);
+  display.endTransfer();
+}
+
+void frameBufferOp(unsigned long i) {
+  frameBuffer[i % sizeof(frameBuffer)] = i;
+  display.writeFrameBuffer();
+}
+#endif
+
+//print the same string over and over, wrapping down the screen
+void runTextTest(const char *name, const FONT_INFO &font) {
+  char text[] = "1234"; //digits, the 22pt font has nothing else
+  display.clearScreen();
+  display.setFont(font);
+  display.fontColor(color(TS_8b_White), color(TS_8b_Blue));
+  uint8_t width = display.getPrintWidth(text);
+  uint8_t height = display.getFontHeight();
+  if (width > 96)
+    width = 96;
+  unsigned long ops = 0;
+  unsigned long start = millis();
+  unsigned long elapsed;
+  do {
+    for (uint8_t i = 0; i < 8; i++) {
+      display.setCursor(0, (ops++ * height) % (64 - height + 1));
+      display.print(text);
+    }
+    elapsed = millis() - start;
+  } while (elapsed < testTime);
+  printResult(name, ops, (unsigned long)width * height * bytesPerPixel, elapsed);
+}
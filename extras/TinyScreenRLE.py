@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+TinyScreenRLE.py - convert a PNG or PPM image to a TinyScreen RLE image
+
+Writes a C array for TinyScreen::drawRLE() to stdout. Colors are BGR like the
+TS_8b and TS_16b color definitions. The format is described in TinyScreen.cpp.
+
+python3 TinyScreenRLE.py image.png --depth 8 --name splashImage > splashImage.h
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+
+def read_ppm(data):
+    # P6 binary PPM, 8 bit channels
+    fields = []
+    pos = 0
+    while len(fields) < 4:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b'#':
+            while data[pos:pos + 1] not in (b'\n', b''):
+                pos += 1
+            continue
+        start = pos
+        while not data[pos:pos + 1].isspace():
+            pos += 1
+        fields.append(data[start:pos])
+    if fields[0] != b'P6' or int(fields[3]) != 255:
+        raise ValueError('only binary 8 bit PPM (P6) files are supported')
+    width, height = int(fields[1]), int(fields[2])
+    pos += 1
+    pixels = [tuple(data[pos + i * 3:pos + i * 3 + 3]) for i in range(width * height)]
+    return width, height, pixels
+
+
+def read_png(data):
+    # non-interlaced 8 bit grayscale, RGB, palette or RGBA PNG
+    pos = 8
+    idat = b''
+    palette = []
+    while pos < len(data):
+        length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if kind == b'IHDR':
+            width, height, depth, color, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif kind == b'PLTE':
+            palette = [tuple(chunk[i:i + 3]) for i in range(0, len(chunk), 3)]
+        elif kind == b'IDAT':
+            idat += chunk
+    if depth != 8 or interlace:
+        raise ValueError('only non-interlaced 8 bit PNG files are supported')
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}[color]
+    raw = zlib.decompress(idat)
+    stride = width * channels
+    rows = []
+    prev = bytearray(stride)
+    pos = 0
+    for _ in range(height):
+        kind = raw[pos]
+        line = bytearray(raw[pos + 1:pos + 1 + stride])
+        pos += 1 + stride
+        for i in range(stride):
+            a = line[i - channels] if i >= channels else 0
+            b = prev[i]
+            c = prev[i - channels] if i >= channels else 0
+            if kind == 1:
+                line[i] = (line[i] + a) & 0xFF
+            elif kind == 2:
+                line[i] = (line[i] + b) & 0xFF
+            elif kind == 3:
+                line[i] = (line[i] + ((a + b) >> 1)) & 0xFF
+            elif kind == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                line[i] = (line[i] + pred) & 0xFF
+        rows.append(line)
+        prev = line
+    pixels = []
+    for line in rows:
+        for x in range(width):
+            px = line[x * channels:(x + 1) * channels]
+            if color == 3:
+                pixels.append(palette[px[0]])
+            elif color in (0, 4):
+                pixels.append((px[0], px[0], px[0]))
+            else:
+                pixels.append(tuple(px[:3]))
+    return width, height, pixels
+
+
+def pack(rgb, depth):
+    r, g, b = rgb
+    if depth == 8:
+        return bytes([(b & 0xE0) | ((g >> 3) & 0x1C) | (r >> 6)])
+    value = ((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3)
+    return bytes([value >> 8, value & 0xFF])
+
+
+def encode(width, height, pixels, depth):
+    packed = [pack(p, depth) for p in pixels]
+    out = bytearray([width, height, 1 if depth == 16 else 0])
+    literal = []
+
+    def flush():
+        while literal:
+            chunk = literal[:128]
+            del literal[:128]
+            out.append(len(chunk) - 1)
+            for px in chunk:
+                out.extend(px)
+
+    i = 0
+    while i < len(packed):
+        run = 1
+        while i + run < len(packed) and run < 0x4000 and packed[i + run] == packed[i]:
+            run += 1
+        if run >= 2:
+            flush()
+            if run <= 64:
+                out.append(0x80 | (run - 1))
+            else:
+                out.extend([0xC0 | ((run - 1) >> 8), (run - 1) & 0xFF])
+            out.extend(packed[i])
+        else:
+            literal.append(packed[i])
+        i += run
+    flush()
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a PNG or PPM image to a TinyScreen RLE image')
+    parser.add_argument('image')
+    parser.add_argument('--depth', type=int, choices=(8, 16), default=8)
+    parser.add_argument('--name', default='rleImage')
+    args = parser.parse_args()
+
+    data = open(args.image, 'rb').read()
+    if data.startswith(b'\x89PNG'):
+        width, height, pixels = read_png(data)
+    else:
+        width, height, pixels = read_ppm(data)
+    if width > 255 or height > 255:
+        sys.exit('images can be at most 255x255 pixels')
+
+    out = encode(width, height, pixels, args.depth)
+    raw = width * height * args.depth // 8
+    print('//%dx%d %d bit RLE image, %d bytes (%d uncompressed)' % (width, height, args.depth, len(out), raw))
+    print('const unsigned char %s[%d] PROGMEM = {' % (args.name, len(out)))
+    for i in range(0, len(out), 16):
+        print('  ' + ','.join('0x%02X' % b for b in out[i:i + 16]) + ',')
+    print('};')
+
+
+if __name__ == '__main__':
+    main()
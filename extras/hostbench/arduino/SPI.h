@@ -0,0 +1,23 @@
+/*
+Stand-in SPI library, every transfer goes to the emulated SSD1331.
+*/
+
+#ifndef HOSTBENCH_SPI_H
+#define HOSTBENCH_SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0
+#define SPI_CLOCK_DIV2 0
+
+class SPIClass {
+ public:
+  void begin(void) {}
+  void setDataMode(uint8_t) {}
+  void setClockDivider(uint8_t) {}
+  uint8_t transfer(uint8_t);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,22 @@
+/*
+Stand-in Wire library, every transaction goes to the emulated SX1505.
+*/
+
+#ifndef HOSTBENCH_WIRE_H
+#define HOSTBENCH_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire {
+ public:
+  void begin(void) {}
+  void beginTransmission(uint8_t);
+  size_t write(uint8_t);
+  uint8_t endTransmission(void);
+  uint8_t requestFrom(uint8_t, uint8_t);
+  int read(void);
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef HOSTBENCH_PGMSPACE_H
+#define HOSTBENCH_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+#endif
@@ -0,0 +1 @@
+//empty stand-in, TinyScreen.cpp includes it for the AVR and SAMD cores
@@ -0,0 +1,295 @@
+/*
+Host benchmark emulator, see emulator.h
+*/
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+#include "emulator.h"
+
+SPIClass SPI;
+TwoWire Wire;
+
+static uint32_t spiClock=8000000;
+static uint32_t i2cClock=400000;
+static double nowNanos=0;
+static BENCH_COUNTERS counters;
+static double countersStart=0;
+static const BENCH_OBSERVER *observer=0;
+
+//TinyScreen+ pins and SX1505 bits, as in TinyScreen.h
+static const uint8_t pinDC=22, pinCS=38;
+static const uint8_t gpioDC=0x01, gpioCS=0x02;
+
+/*
+SSD1331 model
+Only the commands TinyScreen sends are decoded. Flip and mirror are not applied, so images written with
+setFlip(1) appear rotated in the PPM output.
+*/
+
+static uint16_t ram[64][96];
+static uint8_t remap=0;
+static uint8_t cs=1, dc=1;
+static uint8_t colStart=0, colEnd=95, rowStart=0, rowEnd=63, col=0, row=0;
+static uint8_t fillRect=0;
+static uint8_t command=0, args[32], argCount=0, argsNeeded=0;
+static int16_t highByte=-1;
+
+static uint8_t commandArgs(uint8_t c){
+  switch(c){
+    case 0x15: case 0x75: return 2;
+    case 0x21: return 7;
+    case 0x22: return 10;
+    case 0x23: return 6;
+    case 0x25: return 4;
+    case 0x27: return 5;
+    case 0xB8: return 32;
+    case 0x26: case 0x81: case 0x82: case 0x83: case 0x87: case 0x8A: case 0x8B: case 0x8C:
+    case 0xA0: case 0xA1: case 0xA2: case 0xA8: case 0xAD: case 0xB0: case 0xB1: case 0xB3:
+    case 0xBB: case 0xBE: return 1;
+    default: return 0;
+  }
+}
+
+//hardware drawing colors are 6 bits per channel, sent blue first
+static uint16_t color6(uint8_t b, uint8_t g, uint8_t r){
+  return ((b>>1)<<11)|((g&0x3F)<<5)|(r>>1);
+}
+
+static uint16_t color8(uint8_t c){
+  uint16_t b=c>>5, g=(c>>2)&7, r=c&3;
+  return ((b<<2|b>>1)<<11)|((g<<3|g)<<5)|(r<<3|r<<1|r>>1);
+}
+
+static void fillArea(const uint8_t *a, uint16_t edge, uint16_t inside, uint8_t fill){
+  for(int y=a[1];y<=a[3] && y<64;y++)
+    for(int x=a[0];x<=a[2] && x<96;x++){
+      if(y==a[1] || y==a[3] || x==a[0] || x==a[2])ram[y][x]=edge;
+      else if(fill)ram[y][x]=inside;
+    }
+}
+
+static void execute(void){
+  const uint8_t *a=args;
+  if(observer && observer->command)observer->command(command,args,argCount);
+  switch(command){
+    case 0x15: colStart=a[0]; colEnd=a[1]; col=colStart; break;
+    case 0x75: rowStart=a[0]; rowEnd=a[1]; row=rowStart; break;
+    case 0xA0: remap=a[0]; break;
+    case 0x26: fillRect=a[0]&1; break;
+    case 0x25:
+      counters.clears++;
+      fillArea(a,0,0,1);
+      break;
+    case 0x22:
+      counters.rects++;
+      fillArea(a,color6(a[4],a[5],a[6]),color6(a[7],a[8],a[9]),fillRect);
+      break;
+    case 0x21: {
+      counters.lines++;
+      int x0=a[0], y0=a[1], x1=a[2], y1=a[3];
+      int dx=abs(x1-x0), sx=x0<x1?1:-1, dy=-abs(y1-y0), sy=y0<y1?1:-1, e=dx+dy;
+      for(;;){
+        if(x0<96 && y0<64)ram[y0][x0]=color6(a[4],a[5],a[6]);
+        if(x0==x1 && y0==y1)break;
+        int e2=2*e;
+        if(e2>=dy){e+=dy; x0+=sx;}
+        if(e2<=dx){e+=dx; y0+=sy;}
+      }
+      break;
+    }
+    case 0x23: {
+      counters.copies++;
+      static uint16_t copy[64][96];
+      memcpy(copy,ram,sizeof(ram));
+      for(int y=a[1];y<=a[3] && y<64;y++)
+        for(int x=a[0];x<=a[2] && x<96;x++){
+          int nx=a[4]+x-a[0], ny=a[5]+y-a[1];
+          if(nx<96 && ny<64)ram[ny][nx]=copy[y][x];
+        }
+      break;
+    }
+  }
+}
+
+static void writePixel(uint16_t color){
+  if(row<64 && col<96){
+    if(observer && observer->pixel)observer->pixel(col,row,ram[row][col],color);
+    ram[row][col]=color;
+  }
+  if(++col>colEnd){
+    col=colStart;
+    if(++row>rowEnd)row=rowStart;
+  }
+}
+
+static void displayByte(uint8_t b){
+  if(cs)return;
+  if(!dc){
+    counters.commandBytes++;
+    if(argsNeeded){
+      args[argCount++]=b;
+      if(!--argsNeeded)execute();
+      return;
+    }
+    command=b;
+    argCount=0;
+    argsNeeded=commandArgs(b);
+    if(!argsNeeded)execute();
+    return;
+  }
+  counters.dataBytes++;
+  if(remap&0x40){
+    if(highByte<0){
+      highByte=b;
+      return;
+    }
+    writePixel((highByte<<8)|b);
+    highByte=-1;
+  }else{
+    writePixel(color8(b));
+  }
+}
+
+static void setLines(uint8_t newCS, uint8_t newDC){
+  if(cs && !newCS){
+    counters.spiTransactions++;
+    highByte=-1;
+  }
+  cs=newCS;
+  dc=newDC;
+}
+
+uint8_t SPIClass::transfer(uint8_t b){
+  nowNanos+=8e9/spiClock;
+  displayByte(b);
+  return 0xFF;
+}
+
+/*
+SX1505 model
+Registers auto increment after each byte written, like the real part.
+*/
+
+static uint8_t gpioReg[16]={0xFF,0xFF};
+static uint8_t gpioPointer=0, gpioWritten=0;
+
+static void i2cTime(uint8_t bytes){
+  counters.i2cTransactions++;
+  counters.i2cBytes+=bytes;
+  nowNanos+=(9.0*bytes+2)*1e9/i2cClock;
+}
+
+void TwoWire::beginTransmission(uint8_t){
+  gpioWritten=0;
+}
+
+size_t TwoWire::write(uint8_t b){
+  if(!gpioWritten++){
+    gpioPointer=b&15;
+    return 1;
+  }
+  gpioReg[gpioPointer]=b;
+  if(gpioPointer==0)setLines(!!(b&gpioCS),!!(b&gpioDC));
+  gpioPointer=(gpioPointer+1)&15;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(void){
+  i2cTime(1+gpioWritten);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t, uint8_t count){
+  i2cTime(1+count);
+  return count;
+}
+
+int TwoWire::read(void){
+  //buttons are pulled up and never pressed, so they read back high
+  uint8_t value=gpioPointer?gpioReg[gpioPointer]:gpioReg[0]|0xF0;
+  gpioPointer=(gpioPointer+1)&15;
+  return value;
+}
+
+/*
+Pins and time
+*/
+
+void pinMode(uint8_t, uint8_t){}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+  if(pin==pinDC)setLines(cs,!!value);
+  if(pin==pinCS)setLines(!!value,dc);
+}
+
+int digitalRead(uint8_t){
+  return HIGH;
+}
+
+unsigned long micros(void){
+  nowNanos+=1000;
+  return (unsigned long)(nowNanos/1000);
+}
+
+unsigned long millis(void){
+  return micros()/1000;
+}
+
+void delay(unsigned long ms){
+  nowNanos+=ms*1e6;
+}
+
+void delayMicroseconds(unsigned int us){
+  nowNanos+=us*1e3;
+}
+
+void attachInterrupt(uint8_t, void (*)(void), int){}
+void detachInterrupt(uint8_t){}
+
+/*
+Benchmark interface
+*/
+
+void benchSetClocks(uint32_t spiHz, uint32_t i2cHz){
+  spiClock=spiHz;
+  i2cClock=i2cHz;
+}
+
+void benchResetCounters(void){
+  memset(&counters,0,sizeof(counters));
+  countersStart=nowNanos;
+}
+
+const BENCH_COUNTERS &benchCounters(void){
+  counters.modeledMicros=(nowNanos-countersStart)/1000;
+  return counters;
+}
+
+void benchSetObserver(const BENCH_OBSERVER *newObserver){
+  observer=newObserver;
+}
+
+void benchSendByte(uint8_t data, uint8_t dataMode, uint8_t start){
+  if(start)setLines(1,dc);
+  setLines(0,dataMode);
+  nowNanos+=8e9/spiClock;
+  displayByte(data);
+}
+
+void benchReadDisplay(uint16_t *pixels){
+  memcpy(pixels,ram,sizeof(ram));
+}
+
+int benchWritePPM(const char *path){
+  FILE *f=fopen(path,"wb");
+  if(!f)return -1;
+  fprintf(f,"P6\n96 64\n255\n");
+  for(int y=0;y<64;y++)
+    for(int x=0;x<96;x++){
+      uint16_t c=ram[y][x];
+      uint8_t rgb[3]={(uint8_t)((c&0x1F)<<3),(uint8_t)(((c>>5)&0x3F)<<2),(uint8_t)((c>>11)<<3)};
+      fwrite(rgb,1,3,f);
+    }
+  return fclose(f);
+}
@@ -0,0 +1,47 @@
+/*
+Host benchmark emulator
+Behind the stand-in SPI, Wire and pin functions sits a model of the SSD1331 and the SX1505 GPIO expander.
+The SSD1331 decodes the command stream into a 96x64 RGB565 image, and the SX1505 turns register writes into
+the CS and DC lines, so the emulator sees exactly what a real display would.
+Time is modeled, not measured: each SPI byte costs 8 clocks, each I2C transaction costs 9 clocks per byte plus
+start and stop, delay() adds its argument, and every call to micros() costs one microsecond so busy waits on
+hardware commands finish after the time TinyScreen asked for.
+*/
+
+#ifndef HOSTBENCH_EMULATOR_H
+#define HOSTBENCH_EMULATOR_H
+
+#include <stdint.h>
+
+typedef struct
+{
+	uint32_t commandBytes;
+	uint32_t dataBytes;
+	uint32_t spiTransactions;
+	uint32_t i2cTransactions;
+	uint32_t i2cBytes;
+	uint32_t rects;
+	uint32_t lines;
+	uint32_t copies;
+	uint32_t clears;
+	double modeledMicros;
+	
+} BENCH_COUNTERS;
+
+void benchSetClocks(uint32_t spiHz, uint32_t i2cHz);//bus clocks used for modeled time
+void benchResetCounters(void);//clear counters, the modeled clock keeps running
+const BENCH_COUNTERS &benchCounters(void);
+int benchWritePPM(const char *path);//write the emulated display RAM as a binary PPM, returns 0 on success
+void benchReadDisplay(uint16_t *pixels);//copy the emulated display RAM, 96x64 RGB565 pixels row by row
+
+typedef struct
+{
+	void (*command)(uint8_t command, const uint8_t *args, uint8_t count);//each complete command, before it runs
+	void (*pixel)(uint8_t x, uint8_t y, uint16_t oldColor, uint16_t newColor);//each streamed pixel, before it is stored
+	
+} BENCH_OBSERVER;
+
+void benchSetObserver(const BENCH_OBSERVER *);//0 to remove
+void benchSendByte(uint8_t data, uint8_t dataMode, uint8_t start);//send a byte straight to the SSD1331 model, start begins a new transfer
+
+#endif
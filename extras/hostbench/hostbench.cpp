@@ -0,0 +1,528 @@
+/*
+TinyScreen host benchmark
+Runs fixed drawing scenarios through TinyScreen.cpp on Linux, against the stand-in Arduino, SPI and Wire in
+arduino/ and the emulated SSD1331 and SX1505 in emulator.cpp. For each scenario and board it reports the bytes
+and transactions on the bus, the modeled wall time at the given SPI and I2C clocks and the host CPU time.
+The counts are exact and only change when TinyScreen.cpp changes what it sends, so they can be compared
+between commits. Modeled time leaves out the AVR or SAMD CPU time between bytes.
+
+  make && ./hostbench [options] [scenario...]
+  --board shield|plus|all   board to model, all by default
+  --spi-hz N                SPI clock, 8000000 for shields and 12000000 for TinyScreen+ by default
+  --i2c-hz N                I2C clock for the shield's SX1505, 400000 by default
+  --iterations N            runs averaged for host CPU time, 20 by default
+  --csv                     print comma separated values instead of a table
+  --model                   also print the time TinyScreen's cost model predicts per frame, by cause
+  --ppm DIR                 write the emulated display after each scenario to DIR/scenario-board.ppm
+  --check                   instead of benchmarking, check that scrolled sprite frames match a full redraw,
+                            exits with 1 if any pixel differs
+  --trace DIR               hostbench-trace only, write a bus trace of each scenario to DIR/scenario-board.trace
+                            for tracereplay. The trace calls micros() per byte, so modeled times are longer
+*/
+
+#include <time.h>
+#include "Arduino.h"
+#include "TinyScreen.h"
+#include "emulator.h"
+
+typedef struct
+{
+	const char *name;
+	void (*run)(TinyScreen &);
+	uint16_t frames;
+
+} BENCH_SCENARIO;
+
+typedef struct
+{
+	const char *name;
+	uint8_t type;
+	TS_COST_MODEL model;
+
+} BENCH_BOARD;
+
+//17x12 bitmap from the basic example
+static const uint8_t flappyBirdBitmap[17*12]={
+  0xE0,0xE0,0xE0,0xE0,0xE0,0xE0,0x00,0x00,0x00,0x00,0x00,0x00,0xE0,0xE0,0xE0,0xE0,0xE0,
+  0xE0,0xE0,0xE0,0xE0,0x00,0x00,0xFF,0xFF,0xFF,0x00,0xFF,0xFF,0x00,0xE0,0xE0,0xE0,0xE0,
+  0xE0,0xE0,0xE0,0x00,0xFF,0xFF,0x1F,0x1F,0x00,0xFF,0xFF,0xFF,0xFF,0x00,0xE0,0xE0,0xE0,
+  0xE0,0x00,0x00,0x00,0x00,0x1F,0x1F,0x1F,0x00,0xFF,0xFF,0xFF,0x00,0xFF,0x00,0xE0,0xE0,
+  0x00,0xFF,0xFF,0xFF,0xFF,0x00,0x1F,0x1F,0x00,0xFF,0xFF,0xFF,0x00,0xFF,0x00,0xE0,0xE0,
+  0x00,0xFF,0xFF,0xFF,0xFF,0xFF,0x00,0x1F,0x1F,0x00,0xFF,0xFF,0xFF,0xFF,0x00,0xE0,0xE0,
+  0x00,0x1F,0xFF,0xFF,0xFF,0x1F,0x00,0x1F,0x1F,0x1F,0x00,0x00,0x00,0x00,0x00,0x00,0xE0,
+  0xE0,0x00,0x1F,0x1F,0x1F,0x00,0x1F,0x1F,0x1F,0x00,0x03,0x03,0x03,0x03,0x03,0x03,0x00,
+  0xE0,0xE0,0x00,0x00,0x00,0x1F,0x1F,0x1F,0x1F,0x00,0x03,0x00,0x00,0x00,0x00,0x00,0x00,
+  0xE0,0xE0,0x00,0x1F,0x1F,0x1F,0x1F,0x1F,0x1F,0x00,0x03,0x03,0x03,0x03,0x03,0x00,0xE0,
+  0xE0,0xE0,0xE0,0x00,0x00,0x1F,0x1F,0x1F,0x1F,0x1F,0x00,0x00,0x00,0x00,0x00,0xE0,0xE0,
+  0xE0,0xE0,0xE0,0xE0,0xE0,0x00,0x00,0x00,0x00,0x00,0xE0,0xE0,0xE0,0xE0,0xE0,0xE0,0xE0
+};
+
+static uint8_t ballBitmap[16*16];
+static uint8_t frame8[96*64];
+static uint16_t frame16[96*64];
+
+static void makeImages(void){
+  for(int y=0;y<16;y++)
+    for(int x=0;x<16;x++){
+      int dx=2*x-15, dy=2*y-15;
+      ballBitmap[y*16+x]=dx*dx+dy*dy<=225?TS_8b_Red|((x+y)&4?TS_8b_Yellow:0):TS_8b_Black;
+    }
+  for(int y=0;y<64;y++)
+    for(int x=0;x<96;x++){
+      frame8[y*96+x]=TS_RGB8(x*255/95,y*255/63,(x^y)<<2);
+      frame16[y*96+x]=TS_RGB16(x*255/95,y*255/63,(x^y)<<2);
+    }
+}
+
+/*
+Scenarios
+Each one starts after begin() on a cleared screen and must draw the same thing on every run.
+*/
+
+static void drawCircle(TinyScreen &display, int x0, int y0, int radius, uint8_t color){
+  int x=radius;
+  int y=0;
+  int radiusError=1-x;
+  while(x>=y){
+    display.drawPixel(x+x0,y+y0,color);
+    display.drawPixel(y+x0,x+y0,color);
+    display.drawPixel(-x+x0,y+y0,color);
+    display.drawPixel(-y+x0,x+y0,color);
+    display.drawPixel(-x+x0,-y+y0,color);
+    display.drawPixel(-y+x0,-x+y0,color);
+    display.drawPixel(x+x0,-y+y0,color);
+    display.drawPixel(y+x0,-x+y0,color);
+    y++;
+    if(radiusError<0){
+      radiusError+=2*y+1;
+    }else{
+      x--;
+      radiusError+=2*(y-x)+1;
+    }
+  }
+}
+
+static void printCentered(TinyScreen &display, const char *text, int y){
+  char buffer[32];
+  strncpy(buffer,text,sizeof(buffer)-1);
+  buffer[sizeof(buffer)-1]=0;
+  display.setCursor(48-display.getPrintWidth(buffer)/2,y);
+  display.print(text);
+}
+
+//the drawing routines of examples/TinyScreenBasicExample, without the delays
+static void basicScenario(TinyScreen &display){
+  display.clearScreen();
+  display.drawRect(10,10,76,44,TSRectangleFilled,TS_8b_Red);
+  display.drawRect(15,15,66,34,TSRectangleFilled,20,30,60);
+  display.clearWindow(20,20,56,24);
+  display.drawLine(0,0,95,63,TS_8b_Green);
+  display.drawLine(0,63,95,0,0,63,0);
+  for(int i=0;i<64;i++)
+    display.drawLine(0,i,95,i,0,i,63-i);
+
+  drawCircle(display,40,30,30,TS_8b_Red);
+  drawCircle(display,45,30,25,TS_8b_Yellow);
+  drawCircle(display,50,30,20,TS_8b_Blue);
+  drawCircle(display,55,30,15,TS_8b_Brown);
+  drawCircle(display,60,30,10,TS_8b_Green);
+  drawCircle(display,65,30,5,TS_8b_Black);
+
+  display.drawRect(0,0,96,64,TSRectangleFilled,TS_8b_Blue);
+  display.setX(40,40+17-1);
+  display.setY(30,30+12-1);
+  display.startData();
+  display.writeBuffer(flappyBirdBitmap,17*12);
+  display.endTransfer();
+  display.setFlip(true);
+  display.setFlip(false);
+
+  display.clearScreen();
+  display.setFont(thinPixel7_10ptFontInfo);
+  display.fontColor(TS_8b_Green,TS_8b_Black);
+  printCentered(display,"Example Text!",10);
+  display.setCursor(15,25);
+  display.fontColor(TS_8b_Blue,TS_8b_Black);
+  display.print("More example Text!");
+  display.setCursor(3,40);
+  display.fontColor(TS_8b_Red,TS_8b_Black);
+  display.print("(Does not wrap)");
+
+  display.fontColor(TS_8b_White,TS_8b_Black);
+  display.clearScreen();
+  printCentered(display,"Press a Button!",32-display.getFontHeight()/2);
+  const uint8_t buttons[4]={TSButtonUpperLeft,TSButtonLowerLeft,TSButtonUpperRight,TSButtonLowerRight};
+  const int16_t y[4]={0,54,0,54};
+  for(int i=0;i<4;i++){
+    display.setCursor(i<2?0:60,y[i]);
+    display.println(display.getButtons(buttons[i])?"Pressed!":"          ");
+  }
+}
+
+//every line of the screen filled with proportional text on a colored background
+static void textScenario(TinyScreen &display){
+  static const char *lines[]={"The quick brown fox","jumps over the lazy","dog. 0123456789","!@#$%^&*()_+-=[]","TinyScreen text","benchmark 96x64"};
+  display.setFont(liberationSans_8ptFontInfo);
+  display.fontColor(TS_8b_White,TS_8b_Blue);
+  uint8_t height=display.getFontHeight();
+  for(int y=0,i=0;y+height<=64;y+=height,i++){
+    display.setCursor(0,y);
+    display.print(lines[i%6]);
+  }
+}
+
+//four 16x16 sprites bouncing for 60 frames
+static void spriteScenario(TinyScreen &display){
+  TS_SPRITE sprites[4];
+  int8_t dx[4]={1,-2,2,-1};
+  int8_t dy[4]={2,1,-1,-2};
+  for(int i=0;i<4;i++){
+    sprites[i].x=i*20;
+    sprites[i].y=i*12;
+    sprites[i].width=16;
+    sprites[i].height=16;
+    sprites[i].bitmap=ballBitmap;
+    sprites[i].transparentColor=TS_8b_Black;
+    sprites[i].z=i;
+    sprites[i].flags=TSSpriteVisible;
+  }
+  display.setSpriteBackground(TS_8b_DarkGreen);
+  display.setSprites(sprites,4);
+  for(int frame=0;frame<60;frame++){
+    for(int i=0;i<4;i++){
+      sprites[i].x+=dx[i];
+      sprites[i].y+=dy[i];
+      if(sprites[i].x<0 || sprites[i].x>80)dx[i]=-dx[i];
+      if(sprites[i].y<0 || sprites[i].y>48)dy[i]=-dy[i];
+    }
+    display.drawSprites();
+  }
+  display.setSprites(0,0);
+}
+
+//a strip chart scrolled left with copyWindow, one new sample and value label per update
+static void chartScenario(TinyScreen &display){
+  display.setFont(thinPixel7_10ptFontInfo);
+  display.fontColor(TS_8b_White,TS_8b_Black);
+  display.drawLine(0,11,95,11,TS_8b_Gray);
+  uint32_t seed=12345;
+  uint8_t last=40;
+  for(int i=0;i<96;i++){
+    seed=seed*1103515245+12345;
+    uint8_t value=last+(int)((seed>>16)%9)-4;
+    if(value<13)value=13;
+    if(value>63)value=63;
+    display.copyWindow(1,12,95,63,0,12);
+    display.clearWindow(95,12,1,52);
+    display.drawLine(94,last,95,value,TS_8b_Green);
+    display.setCursor(0,0);
+    display.print("value ");
+    display.print(63-value);
+    display.print("  ");
+    last=value;
+  }
+}
+
+//ten full screen 8 bit frames
+static void bitmapScenario(TinyScreen &display){
+  for(int i=0;i<10;i++){
+    display.setX(0,95);
+    display.setY(0,63);
+    display.startData();
+    display.writeBuffer(frame8,96*64);
+    display.endTransfer();
+  }
+}
+
+//ten full screen 16 bit frames
+static void bitmap16Scenario(TinyScreen &display){
+  display.setBitDepth(TSBitDepth16);
+  for(int i=0;i<10;i++){
+    display.setX(0,95);
+    display.setY(0,63);
+    display.startData();
+    display.writeBuffer16(frame16,96*64);
+    display.endTransfer();
+  }
+  display.setBitDepth(TSBitDepth8);
+}
+
+static const BENCH_SCENARIO scenarios[]={
+  {"basic",basicScenario,1},
+  {"text",textScenario,1},
+  {"sprites",spriteScenario,60},
+  {"chart",chartScenario,96},
+  {"bitmap",bitmapScenario,10},
+  {"bitmap16",bitmap16Scenario,10},
+};
+static const int scenarioCount=sizeof(scenarios)/sizeof(scenarios[0]);
+
+//a shield on a 16MHz AVR and a TinyScreen+, SPI and I2C clocks can be changed from the command line
+static BENCH_BOARD boards[]={
+  {"shield",TinyScreenDefault,{8000000,400000,100,500,400,100}},
+  {"plus",TinyScreenPlus,{12000000,0,100,300,400,100}},
+};
+static const int boardCount=sizeof(boards)/sizeof(boards[0]);
+
+/*
+Checks
+Each one draws a frame the incremental way and again from scratch, and compares the emulated display.
+*/
+
+static uint8_t checkTiles[4*64];
+static uint8_t checkMap[16*12];
+
+//a tilemap and a sprite drawn, scrolled by one tile and drawn again, against a full redraw of the same frame
+static uint32_t tilemapScrollCheck(uint8_t type, int dx, int dy, uint8_t hide){
+  static uint16_t scrolled[96*64], redrawn[96*64];
+  for(int t=0;t<4;t++)
+    for(int i=0;i<64;i++)
+      checkTiles[t*64+i]=(i+t)&1?TS_8b_Blue:t*0x24;
+  for(int i=0;i<16*12;i++)
+    checkMap[i]=(i*3+i/16)&3;
+  TS_TILEMAP tilemap={checkTiles,checkMap,16,12,0,0};
+  TS_SPRITE sprite={40,20,16,16,ballBitmap,TS_8b_Black,0,TSSpriteVisible};
+  TinyScreen display(type);
+  display.begin();
+  display.setTilemap(&tilemap);
+  display.setSprites(&sprite,1);
+  display.drawSprites();
+  tilemap.scrollX+=dx;
+  tilemap.scrollY+=dy;
+  if(hide)sprite.flags=0;
+  display.drawSprites();
+  benchReadDisplay(scrolled);
+  display.setTilemap(&tilemap);
+  display.drawSprites();
+  benchReadDisplay(redrawn);
+  uint32_t differ=0;
+  for(int i=0;i<96*64;i++)
+    differ+=scrolled[i]!=redrawn[i];
+  return differ;
+}
+
+static int runChecks(const char *board){
+  static const struct {const char *name; int dx, dy; uint8_t hide;} checks[]={
+    {"scroll-up",0,8,0},
+    {"scroll-up-hide",0,8,1},
+    {"scroll-left",8,0,0},
+    {"scroll-left-hide",8,0,1},
+  };
+  int failed=0;
+  for(int b=0;b<boardCount;b++){
+    if(strcmp(board,"all") && strcmp(board,boards[b].name))continue;
+    for(unsigned c=0;c<sizeof(checks)/sizeof(checks[0]);c++){
+      uint32_t differ=tilemapScrollCheck(boards[b].type,checks[c].dx,checks[c].dy,checks[c].hide);
+      if(differ)
+        printf("%-16s %-6s FAILED, %u pixels differ from a full redraw\n",checks[c].name,boards[b].name,differ);
+      else
+        printf("%-16s %-6s ok\n",checks[c].name,boards[b].name);
+      failed|=!!differ;
+    }
+  }
+  return failed;
+}
+
+#if TS_ENABLE_TRACE
+class FilePrint : public Print {
+ public:
+  FILE *file;
+  size_t write(uint8_t b){
+    return fputc(b,file)!=EOF;
+  }
+};
+
+//traces are streamed straight to the file, the bigger scenarios do not fit in a ring buffer
+static TS_TRACE trace;
+static FilePrint traceFile;
+
+static void writeTraceHeader(uint32_t count){
+  const uint8_t header[16]={'T','S','T','R',2,0,0,0,(uint8_t)count,(uint8_t)(count>>8),(uint8_t)(count>>16),(uint8_t)(count>>24)};
+  fseek(traceFile.file,0,SEEK_SET);
+  fwrite(header,1,sizeof(header),traceFile.file);
+}
+
+static void startTrace(TinyScreen &display, const char *dir, const char *scenario, const char *board){
+  char path[256];
+  snprintf(path,sizeof(path),"%s/%s-%s.trace",dir,scenario,board);
+  traceFile.file=fopen(path,"wb");
+  if(!traceFile.file){
+    fprintf(stderr,"could not write %s\n",path);
+    return;
+  }
+  writeTraceHeader(0xFFFFFFFF);
+  memset(&trace,0,sizeof(trace));
+  trace.stream=&traceFile;
+  display.setTrace(&trace);
+}
+
+//fill in the entry count now that it is known
+static void endTrace(TinyScreen &display){
+  display.setTrace(0);
+  if(!traceFile.file)return;
+  writeTraceHeader((ftell(traceFile.file)-16)/4);
+  fclose(traceFile.file);
+  traceFile.file=0;
+}
+#endif
+
+typedef struct
+{
+	const char *scenario;
+	const char *board;
+	uint16_t frames;
+	double bytes;
+	double control;
+	double busy;
+	
+} BENCH_PREDICTION;
+
+//the cost model's prediction for the traffic counted by the emulator, in ms
+static BENCH_PREDICTION predict(TinyScreen &display, const BENCH_COUNTERS &c){
+  const TS_COST_MODEL &m=display.getCostModel();
+  BENCH_PREDICTION p;
+  p.bytes=display.predictCost(TSCostData,c.commandBytes+c.dataBytes)/1e6;
+  p.control=display.predictCost(TSCostTransfer,c.spiTransactions)/1e6;
+  p.busy=((c.rects+c.copies+c.clears)*m.rectMicros+c.lines*m.lineMicros)/1e3;
+  return p;
+}
+
+static double cpuMicros(void){
+  struct timespec t;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&t);
+  return t.tv_sec*1e6+t.tv_nsec/1e3;
+}
+
+static void usage(void){
+  fprintf(stderr,"usage: hostbench [--board shield|plus|all] [--spi-hz N] [--i2c-hz N] [--iterations N] [--csv] [--model] [--check] [--ppm DIR]%s [scenario...]\nscenarios:",
+    TS_ENABLE_TRACE?" [--trace DIR]":"");
+  for(int i=0;i<scenarioCount;i++)
+    fprintf(stderr," %s",scenarios[i].name);
+  fprintf(stderr,"\n");
+  exit(2);
+}
+
+int main(int argc, char **argv){
+  const char *board="all";
+  const char *ppmDir=0;
+#if TS_ENABLE_TRACE
+  const char *traceDir=0;
+#endif
+  uint32_t spiHz=0, i2cHz=0;
+  int iterations=20;
+  int csv=0;
+  int model=0;
+  int check=0;
+  BENCH_PREDICTION predictions[sizeof(boards)/sizeof(boards[0])*scenarioCount];
+  int predictionCount=0;
+  int selected[scenarioCount];
+  int selectedCount=0;
+  for(int i=1;i<argc;i++){
+    const char *arg=argv[i];
+    const char *value=i+1<argc?argv[i+1]:0;
+    if(!strcmp(arg,"--csv")){
+      csv=1;
+    }else if(!strcmp(arg,"--model")){
+      model=1;
+    }else if(!strcmp(arg,"--check")){
+      check=1;
+    }else if(!strcmp(arg,"--board") && value){
+      board=value; i++;
+    }else if(!strcmp(arg,"--spi-hz") && value){
+      spiHz=strtoul(value,0,0); i++;
+    }else if(!strcmp(arg,"--i2c-hz") && value){
+      i2cHz=strtoul(value,0,0); i++;
+    }else if(!strcmp(arg,"--iterations") && value){
+      iterations=atoi(value); i++;
+    }else if(!strcmp(arg,"--ppm") && value){
+      ppmDir=value; i++;
+#if TS_ENABLE_TRACE
+    }else if(!strcmp(arg,"--trace") && value){
+      traceDir=value; i++;
+#endif
+    }else if(arg[0]=='-'){
+      usage();
+    }else{
+      int s=0;
+      while(s<scenarioCount && strcmp(arg,scenarios[s].name))s++;
+      if(s==scenarioCount || selectedCount==scenarioCount)usage();
+      selected[selectedCount++]=s;
+    }
+  }
+  if(iterations<1 || (strcmp(board,"all") && strcmp(board,"shield") && strcmp(board,"plus")))
+    usage();
+  if(!selectedCount)
+    for(int s=0;s<scenarioCount;s++)
+      selected[selectedCount++]=s;
+  makeImages();
+  if(check)
+    return runChecks(board);
+
+  if(csv)
+    printf("scenario,board,command_bytes,data_bytes,spi_transactions,i2c_transactions,i2c_bytes,hardware_commands,modeled_us,host_cpu_us\n");
+  else
+    printf("%-9s %-6s %9s %9s %7s %7s %8s %6s %11s %10s\n","scenario","board","cmd bytes","data bytes","SPI tx","I2C tx","I2C bytes","hw cmd","modeled ms","host us");
+  for(int b=0;b<boardCount;b++){
+    if(strcmp(board,"all") && strcmp(board,boards[b].name))continue;
+    TS_COST_MODEL &costModel=boards[b].model;
+    if(spiHz)costModel.spiHz=spiHz;
+    if(i2cHz && costModel.i2cHz)costModel.i2cHz=i2cHz;
+    benchSetClocks(costModel.spiHz,costModel.i2cHz?costModel.i2cHz:400000);
+    for(int n=0;n<selectedCount;n++){
+      const BENCH_SCENARIO &scenario=scenarios[selected[n]];
+      BENCH_COUNTERS first;
+      double cpu=0;
+      for(int i=0;i<iterations;i++){
+        TinyScreen display(boards[b].type);
+        display.setCostModel(costModel);
+        display.begin();
+        display.clearScreen();
+        benchResetCounters();
+#if TS_ENABLE_TRACE
+        if(traceDir && !i)startTrace(display,traceDir,scenario.name,boards[b].name);
+#endif
+        double start=cpuMicros();
+        scenario.run(display);
+        cpu+=cpuMicros()-start;
+#if TS_ENABLE_TRACE
+        if(traceDir && !i)endTrace(display);
+#endif
+        if(!i)first=benchCounters();
+        if(!i && model){
+          BENCH_PREDICTION &p=predictions[predictionCount++];
+          p=predict(display,first);
+          p.scenario=scenario.name;
+          p.board=boards[b].name;
+          p.frames=scenario.frames;
+        }
+      }
+      cpu/=iterations;
+      uint32_t hardware=first.rects+first.lines+first.copies+first.clears;
+      if(csv)
+        printf("%s,%s,%u,%u,%u,%u,%u,%u,%.1f,%.1f\n",scenario.name,boards[b].name,first.commandBytes,first.dataBytes,
+          first.spiTransactions,first.i2cTransactions,first.i2cBytes,hardware,first.modeledMicros,cpu);
+      else
+        printf("%-9s %-6s %9u %9u %7u %7u %8u %6u %11.2f %10.1f\n",scenario.name,boards[b].name,first.commandBytes,first.dataBytes,
+          first.spiTransactions,first.i2cTransactions,first.i2cBytes,hardware,first.modeledMicros/1000,cpu);
+      if(ppmDir){
+        char path[256];
+        snprintf(path,sizeof(path),"%s/%s-%s.ppm",ppmDir,scenario.name,boards[b].name);
+        if(benchWritePPM(path))
+          fprintf(stderr,"could not write %s\n",path);
+      }
+    }
+  }
+  if(model){
+    if(csv)
+      printf("\nscenario,board,frames,bytes_ms,control_ms,busy_ms,total_ms,ms_per_frame\n");
+    else
+      printf("\n%-9s %-6s %6s %9s %10s %8s %9s %9s\n","scenario","board","frames","bytes ms","control ms","busy ms","total ms","ms/frame");
+    for(int i=0;i<predictionCount;i++){
+      const BENCH_PREDICTION &p=predictions[i];
+      double total=p.bytes+p.control+p.busy;
+      printf(csv?"%s,%s,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n":"%-9s %-6s %6u %9.2f %10.2f %8.2f %9.2f %9.3f\n",
+        p.scenario,p.board,p.frames,p.bytes,p.control,p.busy,total,total/p.frames);
+    }
+  }
+  return 0;
+}
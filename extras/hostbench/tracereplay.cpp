@@ -0,0 +1,199 @@
+/*
+TinyScreen trace replay
+Reads a trace written by TinyScreen::writeTrace() (or hostbench-trace --trace), replays its SSD1331 bytes into the
+emulated SSD1331 and reports what was sent and what of it was wasted:
+  windows set but unused   column or row windows replaced before any pixel was streamed into them
+  repeated remaps          remap commands that set the value already in place
+  repeated settings        other one byte settings (fill mode, contrast, current, precharge...) and gray tables sent again unchanged
+  overdrawn pixels         streamed pixels that land on a pixel already streamed earlier in the trace
+  unchanged pixels         streamed pixels that write the color already there
+  repeated GPIO writes     SX1505 writes that set every register they touch to the value already there
+Wasted bytes add up the command bytes of the first three and the pixel bytes of unchanged pixels, wasted time is
+those bytes at the SPI clock. SX1505 transactions from version 2 traces are timed at the I2C clock, with the
+address byte, start and stop that the trace leaves out.
+
+  make tracereplay && ./tracereplay [--spi-hz N] [--i2c-hz N] [--ppm FILE] trace.bin
+*/
+
+#include "Arduino.h"
+#include "emulator.h"
+
+static uint32_t opcodeCounts[256];
+static int16_t settings[256];
+static uint8_t grayTable[32];
+static uint8_t grayTableSent=0;
+static uint8_t columnPending=0, rowPending=0;
+static uint32_t unusedWindows=0, repeatedRemaps=0, repeatedSettings=0, wastedCommandBytes=0;
+static uint32_t streamedPixels=0, overdrawnPixels=0, unchangedPixels=0, wastedPixelBytes=0;
+static uint8_t streamed[64][96];
+static uint32_t i2cTransactions=0, i2cBytes=0, repeatedGPIOWrites=0, wastedGPIOBytes=0;
+static int16_t gpioRegs[256];
+static uint8_t gpioPointer=0, gpioSame=0, gpioCount=0;
+
+//close the SX1505 write in progress, counting it if it changed nothing
+static void endGPIOWrite(void){
+  if(gpioCount && gpioSame){
+    repeatedGPIOWrites++;
+    wastedGPIOBytes+=2+gpioCount;
+  }
+  gpioCount=0;
+}
+
+static void onGPIO(uint8_t data, uint8_t flags){
+  if(flags&0x02){
+    endGPIOWrite();
+    i2cTransactions++;
+    i2cBytes+=2;//address and register
+    gpioPointer=data;
+    gpioSame=1;
+    return;
+  }
+  if(flags&0x08){
+    //the read is a second transaction
+    i2cTransactions++;
+    i2cBytes+=2;
+    gpioCount=0;
+    return;
+  }
+  i2cBytes++;
+  gpioCount++;
+  if(gpioRegs[gpioPointer]!=data)gpioSame=0;
+  gpioRegs[gpioPointer]=data;
+  gpioPointer++;
+}
+
+static void onCommand(uint8_t command, const uint8_t *args, uint8_t count){
+  opcodeCounts[command]++;
+  if(command==0x15 || command==0x75){
+    uint8_t &pending=command==0x15?columnPending:rowPending;
+    if(pending){
+      unusedWindows++;
+      wastedCommandBytes+=3;
+    }
+    pending=1;
+  }else if(command==0xB8){
+    if(grayTableSent && !memcmp(grayTable,args,sizeof(grayTable))){
+      repeatedSettings++;
+      wastedCommandBytes+=1+count;
+    }
+    memcpy(grayTable,args,sizeof(grayTable));
+    grayTableSent=1;
+  }else if(count==1){
+    if(settings[command]==args[0]){
+      if(command==0xA0)repeatedRemaps++;
+      else repeatedSettings++;
+      wastedCommandBytes+=2;
+    }
+    settings[command]=args[0];
+  }
+}
+
+static void onPixel(uint8_t x, uint8_t y, uint16_t oldColor, uint16_t newColor){
+  columnPending=0;
+  rowPending=0;
+  streamedPixels++;
+  if(streamed[y][x])overdrawnPixels++;
+  streamed[y][x]=1;
+  if(oldColor==newColor){
+    unchangedPixels++;
+    wastedPixelBytes+=settings[0xA0]>=0 && (settings[0xA0]&0x40)?2:1;
+  }
+}
+
+static uint32_t read32(const uint8_t *p){
+  return p[0]|(p[1]<<8)|(p[2]<<16)|((uint32_t)p[3]<<24);
+}
+
+static void usage(void){
+  fprintf(stderr,"usage: tracereplay [--spi-hz N] [--i2c-hz N] [--ppm FILE] trace.bin\n");
+  exit(2);
+}
+
+int main(int argc, char **argv){
+  uint32_t spiHz=8000000;
+  uint32_t i2cHz=400000;
+  const char *ppm=0;
+  const char *path=0;
+  for(int i=1;i<argc;i++){
+    if(!strcmp(argv[i],"--spi-hz") && i+1<argc)spiHz=strtoul(argv[++i],0,0);
+    else if(!strcmp(argv[i],"--i2c-hz") && i+1<argc)i2cHz=strtoul(argv[++i],0,0);
+    else if(!strcmp(argv[i],"--ppm") && i+1<argc)ppm=argv[++i];
+    else if(argv[i][0]!='-' && !path)path=argv[i];
+    else usage();
+  }
+  if(!path || !spiHz || !i2cHz)usage();
+  FILE *f=fopen(path,"rb");
+  if(!f){
+    perror(path);
+    return 1;
+  }
+  uint8_t header[16];
+  if(fread(header,1,sizeof(header),f)!=sizeof(header) || memcmp(header,"TSTR",4) || header[4]<1 || header[4]>2){
+    fprintf(stderr,"%s: not a version 1 or 2 TinyScreen trace\n",path);
+    return 1;
+  }
+  //a streamed trace that was never finished has a count of 0xFFFFFFFF, read it to the end
+  uint32_t count=read32(header+8);
+  uint32_t dropped=read32(header+12);
+
+  for(int i=0;i<256;i++)settings[i]=-1;
+  for(int i=0;i<256;i++)gpioRegs[i]=-1;
+  BENCH_OBSERVER observer={onCommand,onPixel};
+  benchSetObserver(&observer);
+  benchSetClocks(spiHz,400000);
+  benchResetCounters();
+  uint32_t read=0, longGaps=0;
+  double traceMicros=0;
+  uint8_t entry[4];
+  while(read<count && fread(entry,1,4,f)==4){
+    uint16_t delta=entry[0]|(entry[1]<<8);
+    if(delta==0xFFFF)longGaps++;
+    if(read)traceMicros+=delta;//the first delta is from before the trace
+    if(entry[3]&0x04)
+      onGPIO(entry[2],entry[3]);
+    else
+      benchSendByte(entry[2],entry[3]&0x01,entry[3]&0x02);
+    read++;
+  }
+  endGPIOWrite();
+  fclose(f);
+  if(read<count && count!=0xFFFFFFFF)fprintf(stderr,"%s: truncated, %u of %u entries\n",path,read,count);
+  const BENCH_COUNTERS &c=benchCounters();
+
+  printf("entries              %u\n",read);
+  if(dropped)printf("dropped              %u (the trace starts mid stream)\n",dropped);
+  printf("transactions         %u\n",c.spiTransactions);
+  printf("command bytes        %u\n",c.commandBytes);
+  printf("data bytes           %u\n",c.dataBytes);
+  printf("recorded time        %.3f ms%s\n",traceMicros/1000,longGaps?" or more, some gaps were over 65 ms":"");
+  printf("bus time at %.1f MHz %.3f ms\n",spiHz/1e6,c.modeledMicros/1000);
+  double i2cMicros=(9.0*i2cBytes+2*i2cTransactions)*1e6/i2cHz;
+  if(i2cTransactions){
+    printf("I2C transactions     %u\n",i2cTransactions);
+    printf("I2C bytes            %u\n",i2cBytes);
+    printf("I2C time at %.0f kHz  %.3f ms\n",i2cHz/1e3,i2cMicros/1000);
+  }
+  printf("hardware commands    %u rects, %u lines, %u copies, %u clears\n",c.rects,c.lines,c.copies,c.clears);
+  printf("\n");
+  printf("windows set unused   %u\n",unusedWindows);
+  printf("repeated remaps      %u\n",repeatedRemaps);
+  printf("repeated settings    %u\n",repeatedSettings);
+  printf("streamed pixels      %u\n",streamedPixels);
+  printf("overdrawn pixels     %u\n",overdrawnPixels);
+  printf("unchanged pixels     %u\n",unchangedPixels);
+  if(i2cTransactions)printf("repeated GPIO writes %u, %.3f ms\n",repeatedGPIOWrites,(9.0*wastedGPIOBytes+2*repeatedGPIOWrites)*1e3/i2cHz);
+  uint32_t wasted=wastedCommandBytes+wastedPixelBytes;
+  printf("wasted bytes         %u (%u command, %u pixel), %.1f%% of the trace\n",wasted,wastedCommandBytes,wastedPixelBytes,
+    read?100.0*wasted/read:0.0);
+  printf("wasted time          %.3f ms\n",wasted*8e3/spiHz);
+  printf("\n");
+  printf("commands\n");
+  for(int i=0;i<256;i++)
+    if(opcodeCounts[i])printf("  0x%02X %u\n",i,opcodeCounts[i]);
+
+  if(ppm && benchWritePPM(ppm)){
+    fprintf(stderr,"could not write %s\n",ppm);
+    return 1;
+  }
+  return 0;
+}